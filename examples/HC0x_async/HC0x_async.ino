@@ -0,0 +1,57 @@
+/**
+ * HC-0x Non-blocking Configuration Example
+ *
+ *  Description: Detect and configure HC-05/06 without blocking loop(). Requires
+ *              2nd UART (Serial1) defined. Operations are started with the
+ *              begin...() methods and advanced by calling poll() from loop(),
+ *              leaving loop() free to service other tasks while waiting for
+ *              responses of HC-0x device.
+ *
+ *              HC-0x must be in configuration mode (AT mode) (LED blinking to
+ *              indicate Not Connected). See HC05_config example for connections.
+ *
+ *      Author: ndroid
+ */
+
+#include <configureBT.h>
+
+#define MODE_PIN    10
+#define STATE_PIN    9
+
+HCBT hc0x(MODE_PIN, STATE_PIN);
+
+unsigned long lastBlink = 0;
+bool named = false;
+
+// called by poll() when operation completes
+void completed(HCBT *device, int operation, bool success) {
+  if (operation == HC_OP_DETECT) {
+    Serial.println(success ? "Device detected." : "Device not identified!");
+    if (success) {
+      device->beginSetName("HC0x_async");
+    }
+  } else if (operation == HC_OP_SET_NAME) {
+    Serial.println(success ? "Name set." : "Setting name failed!");
+    named = true;
+  }
+}
+
+void setup() {
+  // configure Serial Monitor UART (57600 8N1)
+  Serial.begin(57600);
+  pinMode(LED_BUILTIN, OUTPUT);
+  delay(1000);
+  hc0x.setCallback(completed);
+  hc0x.beginDetect();
+}
+
+void loop() {
+  // advance detection/configuration of HC-0x, never waits for device response
+  hc0x.poll();
+
+  // other tasks continue to be serviced while HC-0x is configured
+  if (millis() - lastBlink >= (named ? 1000 : 100)) {
+    lastBlink = millis();
+    digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
+  }
+}
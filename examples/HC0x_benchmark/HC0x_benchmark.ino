@@ -0,0 +1,125 @@
+/**
+ * HC-0x Detection Benchmark
+ *
+ *  Description: Measures detectDevice() against simulated HC-0x modules for
+ *              every combination of firmware, model, baud rate and parity
+ *              supported by detection. For each combination, prints modeled
+ *              detection time, count of probe transactions, characters
+ *              written to the module, and Serial1 begin()/end() calls,
+ *              followed by worst-case and average detection time. The matrix
+ *              runs once for each response of the module to mismatched baud
+ *              rate or parity: silent (worst case), and garbled replies.
+ *
+ *              Each detection starts without hint (worst case after reset).
+ *              Time is modeled with a virtual clock, so the full matrix runs
+ *              in well under a second.
+ *
+ *              Requires host build with HC_SIMULATOR defined, e.g. with
+ *              EpoxyDuino (EXTRA_CXXFLAGS = -DHC_SIMULATOR). "make bench" 
+ *              builds and runs it with the Makefile of this folder.
+ *
+ *      Author: ndroid
+ */
+
+#include <configureBT.h>
+#include <simulateBT.h>
+
+#ifndef HC_SIMULATOR
+  #error "HC0x_benchmark requires host build with HC_SIMULATOR defined"
+#endif
+
+HCVirtualClock virtualClock;
+
+unsigned long worstTime;
+unsigned long totalTime;
+int cells;
+int failures;
+
+void benchmark(int model, int firmware, int baud, int parity, int mismatch) {
+  HCBT hc0x(0, 0);
+  unsigned long start;
+  bool detected;
+
+  HCSim.setDevice(model, firmware);
+  HCSim.setUART(baudRateList[baud], parity);
+  HCSim.setMismatch(mismatch, mismatch);
+  HCSim.setClock(&virtualClock);
+  HCSim.powerCycle();
+  HCSim.resetCounters();
+  hc0x.setClock(&virtualClock);
+
+  start = virtualClock.millis();
+  detected = hc0x.detectDevice();
+  start = virtualClock.millis() - start;
+
+  Serial.print(model == MODEL_HC05 ? "HC-05" : "HC-06");
+  Serial.print(firmware == FIRM_VERSION1 ? "\t1.x\t" : "\t2.x\t");
+  Serial.print(baudRateList[baud]);
+  Serial.print("\t");
+  Serial.print(flashStr(parityType, parity));
+  Serial.print("\t");
+  Serial.print(detected ? "OK\t" : "FAIL\t");
+  Serial.print(start);
+  Serial.print("\t");
+  Serial.print(hc0x.detectProbes());
+  Serial.print("\t");
+  Serial.print(HCSim.bytesWritten());
+  Serial.print("\t");
+  Serial.print(HCSim.uartBegins());
+  Serial.print("\t");
+  Serial.println(HCSim.uartEnds());
+
+  if (!detected)  failures++;
+  if (start > worstTime)  worstTime = start;
+  totalTime += start;
+  cells++;
+}
+
+// run every combination, with response of simulated module to mismatched baud
+//  rate/parity HC_SIM_SILENT or HC_SIM_GARBLED, and return count of failures
+int benchmarkAll(int mismatch) {
+  worstTime = 0;
+  totalTime = 0;
+  cells = 0;
+  failures = 0;
+  Serial.println((mismatch == HC_SIM_SILENT) ? "Mismatch: silent" : "Mismatch: garbled");
+  Serial.println("Model\tFW\tBaud\tParity\tResult\tms\tProbes\tBytes\tBegins\tEnds");
+
+  for (int firmware = FIRM_VERSION1; firmware <= FIRM_VERSION2; firmware++) {
+    for (int model = MODEL_HC06; model <= MODEL_HC05; model++) {
+      // firmware 1.x is only found on HC-06 modules
+      if ((firmware == FIRM_VERSION1) && (model == MODEL_HC05))  continue;
+      for (int baud = VERS2_MIN_BAUD; baud < BAUD_LIST_CNT; baud++) {
+        for (int parity = NOPARITY; parity <= EVENPARITY; parity++) {
+          benchmark(model, firmware, baud, parity, mismatch);
+        }
+      }
+    }
+  }
+
+  Serial.println();
+  Serial.print("Combinations: ");
+  Serial.print(cells);
+  Serial.print(", failed: ");
+  Serial.println(failures);
+  Serial.print("Worst-case detection (ms): ");
+  Serial.println(worstTime);
+  Serial.print("Average detection (ms): ");
+  Serial.println(totalTime / cells);
+  Serial.println();
+  return failures;
+}
+
+void setup() {
+  int failed;
+
+  Serial.begin(57600);
+  failed = benchmarkAll(HC_SIM_SILENT);
+  failed += benchmarkAll(HC_SIM_GARBLED);
+#ifdef EPOXY_DUINO
+  exit(failed > 0);
+#endif
+}
+
+void loop() {
+}
@@ -0,0 +1,81 @@
+/**
+ * HC-0x Fleet Provisioning Example
+ *
+ *  Description: Provision a tray of HC-05/06 modules from a Linux PC, one
+ *              module per USB-UART adapter. Each job names the port of its
+ *              module and the name, pin, role and UART settings to write.
+ *              Ports run concurrently, so detection of one module never
+ *              waits on another, and jobs of each port run in list order.
+ *              Prints result of each job, then jobs, failures, busy and
+ *              detection time, and modules per minute of each port.
+ *
+ *              Requires host build with HC_TERMIOS defined, e.g. with
+ *              EpoxyDuino (EXTRA_CXXFLAGS = -DHC_TERMIOS). See README.
+ *              More than 4 ports also require HC_MANAGER_MAX as a build
+ *              flag (e.g. EXTRA_CXXFLAGS = -DHC_TERMIOS -DHC_MANAGER_MAX=8),
+ *              not a #define in this sketch.
+ *
+ *      Author: ndroid
+ */
+
+#include <configureBT.h>
+#include <manageBT.h>
+#include <termiosBT.h>
+
+#ifndef HC_TERMIOS
+  #error "HC0x_fleet requires host build with HC_TERMIOS defined"
+#endif
+
+#define JOB_CNT     4
+
+HCTermios port0("/dev/ttyUSB0");
+HCTermios port1("/dev/ttyUSB1");
+HCTermios port2("/dev/ttyUSB2");
+HCTermios port3("/dev/ttyUSB3");
+HCBT hc0x0(port0);
+HCBT hc0x1(port1);
+HCBT hc0x2(port2);
+HCBT hc0x3(port3);
+
+HCManager fleet;
+
+//  port, name, pin, role, baud, parity (0 - None, 1 - Odd, 2 - Even)
+HCJob jobs[JOB_CNT] = {
+  HCJob(0, "TRAY_A1", "1001", ROLE_SECONDARY, 38400, 0),
+  HCJob(1, "TRAY_A2", "1002", ROLE_SECONDARY, 38400, 0),
+  HCJob(2, "TRAY_A3", "1003", ROLE_PRIMARY, 115200, 0),
+  HCJob(3, "TRAY_A4", "1004", ROLE_UNKNOWN, 9600, 2),
+};
+
+void setup() {
+  Serial.begin(57600);
+
+  fleet.add(hc0x0);
+  fleet.add(hc0x1);
+  fleet.add(hc0x2);
+  fleet.add(hc0x3);
+
+  unsigned long start = millis();
+  bool success = fleet.runJobs(jobs, JOB_CNT);
+  Serial.print("Tray provisioned in (ms): ");
+  Serial.println(millis() - start);
+  for (int j = 0; j < JOB_CNT; j++) {
+    Serial.print(jobs[j].name);
+    if (jobs[j].status == HC_SUCCESS) {
+      Serial.println(": OK");
+    } else {
+      Serial.print(": failed ");
+      Serial.println((jobs[j].failedOp == HC_OP_DETECT) ? "(not detected)" :
+                     (jobs[j].failedOp == HC_OP_NONE) ? "(no port)" : "(configuration)");
+    }
+  }
+  Serial.println(success ? "All jobs succeeded." : "Some jobs failed!");
+  Serial.println();
+  fleet.printStats();
+#ifdef EPOXY_DUINO
+  exit(success ? 0 : 1);
+#endif
+}
+
+void loop() {
+}
@@ -0,0 +1,57 @@
+/**
+ * HC-0x Linux Host Configuration Example
+ *
+ *  Description: Detect and configure an HC-05/06 module connected to a USB-UART
+ *              adapter of a Linux PC, without an Arduino. Prints detected
+ *              firmware, then writes name, pin and UART settings.
+ *
+ *              HC-0x must be in configuration mode (AT mode) (LED blinking to
+ *              indicate Not Connected). EN/KEY of HC-05 must be held high by
+ *              the adapter wiring, since the PC has no KEY/STATE pins.
+ *
+ *              Requires host build with HC_TERMIOS defined, e.g. with
+ *              EpoxyDuino (EXTRA_CXXFLAGS = -DHC_TERMIOS). See README.
+ *
+ *      Author: ndroid
+ */
+
+#include <configureBT.h>
+#include <termiosBT.h>
+
+#ifndef HC_TERMIOS
+  #error "HC0x_linux requires host build with HC_TERMIOS defined"
+#endif
+
+#define PORT_PATH   "/dev/ttyUSB0"
+
+HCTermios port(PORT_PATH);
+HCBT hc0x(port);
+
+void setup() {
+  HCConfig config;
+  bool success;
+
+  Serial.begin(57600);
+  if (!hc0x.detectDevice(true)) {
+    Serial.print("Device not identified on ");
+    Serial.println(port.path());
+#ifdef EPOXY_DUINO
+    exit(1);
+#endif
+    return;
+  }
+  Serial.println(hc0x.getVersionString());
+
+  config.name = "HC0x_linux";
+  config.pin = "4321";
+  config.baud = 38400;
+  config.parity = 0;      // no parity
+  success = hc0x.applyConfig(config, true);
+  Serial.println(success ? "Configuration written." : "Configuration failed!");
+#ifdef EPOXY_DUINO
+  exit(success ? 0 : 1);
+#endif
+}
+
+void loop() {
+}
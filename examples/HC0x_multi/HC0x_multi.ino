@@ -0,0 +1,56 @@
+/**
+ * HC-0x Multiple Device Provisioning Example
+ *
+ *  Description: Detect and configure three HC-05/06 modules at once, each
+ *              connected to its own UART of an Arduino Mega (Serial1, Serial2
+ *              and Serial3) with its own EN/KEY and STATE pins. HCManager
+ *              interleaves the operations of the modules, so all three are
+ *              provisioned in about the time of the slowest one.
+ *
+ *              HC-0x modules must be in configuration mode (AT mode) (LED
+ *              blinking to indicate Not Connected). See HC05_config example
+ *              for connections.
+ *
+ *      Author: ndroid
+ */
+
+#include <configureBT.h>
+#include <manageBT.h>
+
+#define DEVICE_CNT  3
+
+HCBT hc0x1(Serial1, 10, 9);
+HCBT hc0x2(Serial2, 12, 11);
+HCBT hc0x3(Serial3, 8, 7);
+
+HCManager fleet;
+HCConfig config[DEVICE_CNT];
+
+void setup() {
+  // configure Serial Monitor UART (57600 8N1)
+  Serial.begin(57600);
+  delay(1000);
+
+  fleet.add(hc0x1);
+  fleet.add(hc0x2);
+  fleet.add(hc0x3);
+  for (int i = 0; i < DEVICE_CNT; i++) {
+    config[i].name = String("HC0x_fleet") + (i + 1);
+    config[i].pin = "4321";
+    config[i].baud = 38400;
+    config[i].parity = 0;     // no parity
+    fleet.setConfig(i, config[i]);
+  }
+
+  unsigned long start = millis();
+  fleet.provisionAll();
+  Serial.print("Provisioned in (ms): ");
+  Serial.println(millis() - start);
+  for (int i = 0; i < DEVICE_CNT; i++) {
+    Serial.print(config[i].name);
+    Serial.println((fleet.result(i) == HC_SUCCESS) ? ": OK" : ": failed");
+  }
+}
+
+void loop() {
+}
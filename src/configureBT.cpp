@@ -17,28 +17,120 @@
 
 #include "configureBT.h"
 #include "includes/constants.h"
+#include "includes/atCommand.h"
 
+#if defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_MEGAAVR)
+  // detection hint may be persisted in EEPROM
+  #define HC_EEPROM_HINT  1
+  #include <EEPROM.h>
+#endif
 
-// TODO add support for specifying UART for AT communication
-/*
-HCBT::HCBT(Stream *uart, int keyPin, int statePin) {
-  _uart = uart;
-  _statePin = statePin;
-  _keyPin = keyPin;
-  _mode = MODE_DATA;
-  uartBegun = false;
-  initDevice();
-  if (statePin > 0) pinMode(statePin, INPUT);
-  if (keyPin > 0) pinMode(keyPin, INPUT);
+// Default UART connected to HC-0x. Host builds define HC_SIMULATOR to connect
+//  the simulated module of simulateBT.h in place of Serial1, or HC_TERMIOS to
+//  use a serial port of the host given to the constructor (no default).
+#ifdef HC_SIMULATOR
+  #include "simulateBT.h"
+  #define HC_SERIAL       HCSim
+#elif defined(HC_TERMIOS)
+  #include "termiosBT.h"
+#else
+  #define HC_SERIAL       Serial1
+#endif
+
+#if SCAN_CELL_CNT > 48
+  #error "HCBT::_probed too small for detection scan"
+#endif
+
+#if (BAUD_LIST_CNT - VERS2_MIN_BAUD) > 6
+  #error "HCBT::_baudGuess too small for baud rate estimate"
+#endif
+
+static_assert(OTHER_CMD + 1 == HC_CMD_CNT, "HC_CMD_CNT does not match HCxxCommands");
+static_assert(ERROR_CODE_CNT == HC_ERR_UNKNOWN, "HCError does not match errorCodes");
+static_assert(PROPERTY_CNT <= 8, "HCSnapshot::valid too small for propertyQueries");
+
+
+// Advance pos past next occurrence of c in status line (flash), '#' matching
+//  any hexadecimal digit. False if c does not follow pos, so line is no status
+static bool statusNext(const char *status, unsigned int &pos, char c) {
+  char expected;
+
+  for (; (expected = pgm_read_byte(&status[pos])) != '\0'; pos++) {
+    if ((expected == c) || ((expected == '#') && isxdigit(c))) {
+      pos++;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Error code x of ERROR:(x) status, as hexadecimal digits followed by ')'
+static HCError errorCode(const char *text) {
+  int code = 0;
+  int digits = 0;
+
+  for (; isxdigit(*text) && (digits < 2); text++, digits++) {
+    code = code * 16 + (isdigit(*text) ? (*text - '0') : (toupper(*text) - 'A' + 10));
+  }
+  if ((digits == 0) || (*text != ')') || (code >= (int)ERROR_CODE_CNT))
+    return HC_ERR_UNKNOWN;
+  return (HCError)code;
 }
-*/
 
-HCBT::HCBT(int keyPin, int statePin) {
-  _uart = NULL;
+// Copy value of +KEY:value line, without quotes, up to end of line
+static bool copyValue(char *field, const char *value, int maxChars) {
+  int length = 0;
+
+  if (*value == '"')  value++;
+  while ((length < maxChars) && (value[length] != '\r') && (value[length] != '\n')
+          && (value[length] != '"') && (value[length] != '\0')) {
+    field[length] = value[length];
+    length++;
+  }
+  field[length] = '\0';
+  return (length > 0);
+}
+
+HCClock HCArduinoClock;
+
+#ifndef HC_TERMIOS
+HCBT::HCBT(int keyPin, int statePin) : HCBT(HC_SERIAL, keyPin, statePin) {
+}
+#endif
+
+HCBT::HCBT(HCSerial &uart, int keyPin, int statePin) {
+  _uart = &uart;
   _statePin = statePin;
   _keyPin = keyPin;
   _mode = MODE_DATA;
+  // HCArduinoClock may not be constructed yet if HCBT is also a global object
+  _clock = &HCArduinoClock;
+  _modeSince = millis() - SHORT_DELAY;
+  _sessionDepth = 0;
+  _rxClean = false;
   uartBegun = false;
+  _txSent = false;
+  _txState = TX_IDLE;
+  _txCount = 0;
+  _txStatus[0] = HC_IDLE;
+  _txError[0] = HC_ERR_NONE;
+  _op = HC_OP_NONE;
+  _opStep = STEP_IDLE;
+  _opResult = HC_IDLE;
+  _callback = NULL;
+  _pipeCommands[0] = '\0';
+  _pipeCount = 0;
+  _pipeSent = false;
+  _cfgResult.name = _cfgResult.pin = _cfgResult.role = _cfgResult.uart = HC_IDLE;
+  _cfgCommit = false;
+  _staged = 0;
+  _hintFirmware = FIRM_UNKNOWN;
+  _hintModel = MODEL_UNKNOWN;
+  _hintAddress = -1;
+  _probeCount = 0;
+#ifdef HC_TX_STATS
+  resetTxStats();
+#endif
   initDevice();
   if (statePin > 0) pinMode(statePin, INPUT);
   if (keyPin > 0) pinMode(keyPin, INPUT);
@@ -51,12 +143,15 @@ void HCBT::initDevice() {
   baudRate = VERS2_MIN_BAUD;
   uartParity = NOPARITY;
   stopBits = STOP1BIT;
-  versionString = "";
-  btName = "";
+  versionString[0] = '\0';
+  btName[0] = '\0';
+  btPin[0] = '\0';
 }
 
 void HCBT::commandMenu() {
   String command;
+  // remain in command mode for detection and selected action
+  HCCommandSession session(*this);
 
   while (VERSION_UNKNOWN) {
     if (detectDevice(true))   break;
@@ -65,7 +160,7 @@ void HCBT::commandMenu() {
     Serial.println("Device version/configuration unknown.");
     Serial.println("Check connections and enter any character to scan again.");
     while (Serial.available() < 1);
-    delay(SHORT_DELAY);
+    _clock->delay(SHORT_DELAY);
   }
   // clear any existing messages in buffer
   clearSerial();
@@ -105,387 +200,1101 @@ void HCBT::commandMenu() {
   }
   Serial.println();
   
-  delay(SHORT_DELAY);
+  _clock->delay(SHORT_DELAY);
+}
+
+bool HCBT::switchMode(int mode) {
+  if (_mode == mode)  return false;
+  _mode = mode;
+  if (_keyPin <= 0)   return false;
+  if (mode == MODE_COMMAND) {
+    pinMode(_keyPin, OUTPUT);
+    digitalWrite(_keyPin, MODE_COMMAND);
+  } else {
+    digitalWrite(_keyPin, MODE_DATA);
+    // low or floating signal disables command mode
+    pinMode(_keyPin, INPUT);
+  }
+  _modeSince = _clock->millis();
+  return true;
 }
 
 void HCBT::setCommandMode() {
-  if (_mode != MODE_COMMAND) {
-    if (_keyPin > 0) {
-      pinMode(_keyPin, OUTPUT);
-      digitalWrite(_keyPin, MODE_COMMAND);
-      delay(SHORT_DELAY);
-    }
-    _mode = MODE_COMMAND;
+  if (switchMode(MODE_COMMAND)) {
+    _clock->delay(SHORT_DELAY);
   }
 }
 
 void HCBT::setDataMode() {
-  if (_mode != MODE_DATA) {
-    if (_keyPin > 0) {
-      digitalWrite(_keyPin, MODE_DATA);
-      // low or floating signal disables command mode
-      pinMode(_keyPin, INPUT);
-      delay(SHORT_DELAY);
-    }
-    _mode = MODE_DATA;
+  if (switchMode(MODE_DATA)) {
+    _clock->delay(SHORT_DELAY);
   }
 }
 
-void HCBT::responseDelay(unsigned long characters, int firmware, int command) {
-  if ((baudRate < 0) || (baudRate >= BAUD_LIST_CNT)) return;
-  unsigned long writeMS = (characters + responseChars[command]) * BITS_PER_CHAR * 1000 
-                              / baudRateList[baudRate];
-  delay(writeMS + responseMS[firmware]);
+void HCBT::beginSession() {
+  // pin is allowed to settle by first transaction of session
+  if (_sessionDepth++ == 0) {
+    switchMode(MODE_COMMAND);
+  }
 }
 
-void HCBT::clearStreams() {
-  clearSerial();
-  clearInputStream(firmVersion);
+void HCBT::endSession() {
+  if (_sessionDepth <= 0)   return;
+  // data mode is restored by finishOperation() if operation is busy
+  if ((--_sessionDepth == 0) && !busy()) {
+    setDataMode();
+  }
 }
 
-void HCBT::clearSerial() {
-  while (Serial.available() > 0) {
-    // wait until input stream is clear
-    Serial.read();
-  }
+HCCommandSession::HCCommandSession(HCBT &device) : _device(device) {
+  _device.beginSession();
 }
 
-void HCBT::clearInputStream(int firmware) {
-  setCommandMode();
-  if (firmware == FIRM_VERSION2) {
-    // ensure HC0x is not waiting for termination of partially complete command
-    Serial1.print(lineEnding[FIRM_VERSION2]);
-    Serial1.flush();
-    delay(FW2_RESPONSE);
-  }
-  while (Serial1.available() > 0) {
-    // wait until input stream is clear
-    Serial1.read();
-  }
-  // does not return to data mode following call to clear stream,
-  //  since calling functions expect to be in command mode
+HCCommandSession::~HCCommandSession() {
+  _device.endSession();
 }
 
-void HCBT::printMenu() {
-  Serial.println("\n");
-  Serial.write('\f');   // Form feed (not supported in Serial Monitor)
-  Serial.println(responsePrefix[deviceModel] + versionString);
-  Serial.print("\tBaud rate: ");
-  Serial.println(baudRateList[baudRate]);
-  Serial.print("\tParity: ");
-  Serial.println(parityType[uartParity]);
-  Serial.println();
-  Serial.println("Select option:");
-  for (int i = 1; i < HC06_MENUSIZE; i++) {
-    Serial.println(String("\t(") + i + hc06Menu[i]);
+void HCBT::startWait(unsigned long period) {
+  _waitStart = _clock->millis();
+  _waitPeriod = period;
+}
+
+bool HCBT::waitDone() {
+  return ((_clock->millis() - _waitStart) >= _waitPeriod);
+}
+
+unsigned long HCBT::responseTime(unsigned long characters, int firmware, int command) {
+  if ((baudRate < 0) || (baudRate >= BAUD_LIST_CNT)) return 0;
+  unsigned long writeMS = (characters + responseChars[command]) * BITS_PER_CHAR * 1000 
+                              / baudRateList[baudRate];
+  return (writeMS + responseMS[firmware] + transportLatency());
+}
+
+unsigned long HCBT::idleGap() {
+  if ((baudRate < 0) || (baudRate >= BAUD_LIST_CNT)) 
+    return (FW2_RESPONSE + transportLatency());
+  // round up to whole ms, plus 1 ms for resolution of millis()
+  return ((IDLE_GAP_CHARS * BITS_PER_CHAR * 1000UL + baudRateList[baudRate] - 1) 
+              / baudRateList[baudRate] + 1 + transportLatency());
+}
+
+unsigned long HCBT::transportLatency() {
+#ifdef HC_TERMIOS
+  // host serial drivers deliver characters in bursts (e.g. latency timer of
+  //  USB-UART adapters), so reply may pause for longer than a few characters
+  return _uart->latency();
+#else
+  return 0;
+#endif
+}
+
+void HCBT::startTransaction(const char *command, int firmware, int cmdIndex, 
+                            int replies) {
+  _txCommand = command;
+  _txCmdLength = strlen(command);
+  _txFirmware = firmware;
+  _txIndex = cmdIndex;
+  _txResponse[0] = '\0';
+  _txLength = 0;
+  _txLineStart = 0;
+  _txComplete = false;
+  _txCount = replies;
+  _txReplies = 0;
+  for (int i = 0; i < HC_PIPELINE_MAX; i++) {
+    _txStatus[i] = HC_IDLE;
+    _txError[i] = HC_ERR_NONE;
   }
-  Serial.println();
+  // allow EN/KEY pin to settle if HC-05 was not already in command mode
+  switchMode(MODE_COMMAND);
+  unsigned long settled = _clock->millis() - _modeSince;
+  startWait((settled < SHORT_DELAY) ? (SHORT_DELAY - settled) : 0);
+  _txState = TX_MODE;
+#ifdef HC_TX_STATS
+  if ((_txIndex < 0) || (_txIndex >= HC_CMD_CNT))  _txIndex = OTHER_CMD;
+  _txStats[_txIndex].modeAt = _clock->millis();
+  _txStats[_txIndex].flushAt = 0;
+  _txStats[_txIndex].writeAt = 0;
+  _txStats[_txIndex].firstByteAt = 0;
+#endif
 }
 
-bool HCBT::detectDevice(bool verboseOut) {
-  String command;
-  String comBuffer;
+bool HCBT::pollTransaction() {
+  char inChar;
+  const char *value;
 
-  initDevice();
-  if (!uartBegun) {
-    // protect against board packages which do not check for Serial begun prior
-    //  to executing end()
-    Serial1.begin(9600);
-    delay(SHORT_DELAY);
-    uartBegun = true;
-  }
-  Serial1.end();
-  delay(CONFIG_DELAY);
-  if (verboseOut) {
-    Serial.print("\nSearching for firmware and version of HC0x device");
-  }
-  setCommandMode();
-  // Scan through possible UART configurations for each firmware version. 
-  //  Use AT command to test for OK response.
-  for (int firmware = FIRM_VERSION2; firmware > FIRM_UNKNOWN; firmware--) {
-    for (uartParity = NOPARITY; uartParity < PARITY_LIST_CNT; uartParity++) {
-      // firmware version 2.x/3.x does not support baud rate below 4800
-      if (firmware == FIRM_VERSION2) {
-        baudRate = VERS2_MIN_BAUD;
-      } else {
-        // currently only support min baud of 4800 to avoid conflict with
-        //  devices which only implement UART min of 4800
-        baudRate = VERS2_MIN_BAUD;
+  switch (_txState) {
+    case TX_MODE:
+      if (!waitDone())  return false;
+      if ((_txFirmware == FIRM_VERSION2) && !_rxClean) {
+        // ensure HC0x is not waiting for termination of partially complete command.
+        //  Not required once previous response ended with complete status line.
+        _uart->print(ENDLINE_NLCR);
+        _txSentAt = _clock->millis();
+        _txSent = true;
+        startWait(FW2_RESPONSE);
       }
-      for ( ; baudRate < BAUD_LIST_CNT; baudRate++) {
-        // Test for Version x.x firmware AT echo
-        command = atCommands[ECHO] + lineEnding[firmware]; // AT command
+      // parser state is unknown until this transaction completes
+      _rxClean = false;
+      _txState = TX_FLUSH;
+      return false;
+    case TX_FLUSH:
+      if (!waitDone())  return false;
+      clearInputStream();
+#ifdef HC_TX_STATS
+      _txStats[_txIndex].flushAt = _clock->millis();
+#endif
 #ifdef DEBUG
-        // debugging instructions to verify characters sent to UART
-        Serial.print("\nCommand length: ");
-        Serial.println(command.length());
-        for (unsigned int i = 0; i < command.length(); i++) {
-          Serial.print("\t");
-          Serial.print(command.charAt(i), HEX);
+      // debugging instructions to verify characters sent to UART
+      Serial.print("\nCommand length: ");
+      Serial.println(_txCmdLength);
+      for (unsigned int i = 0; i < _txCmdLength; i++) {
+        Serial.print("\t");
+        Serial.print(_txCommand[i], HEX);
+      }
+      Serial.println();
+#endif
+      _uart->print(_txCommand);
+      _txSentAt = _clock->millis();
+      _txSent = true;
+#ifdef HC_TX_STATS
+      // instrumented builds wait for transmission, so that write time is known
+      _uart->flush();
+      _txStats[_txIndex].writeAt = _clock->millis();
+#endif
+      // response period includes time to write command, so Serial1 is not flushed
+      startWait(responseTime(_txCmdLength, _txFirmware, _txIndex));
+      _txState = TX_WAIT;
+      return false;
+    case TX_WAIT:
+    case TX_RECEIVE:
+      while (_uart->available() > 0) {
+        inChar = (char)_uart->read();
+        appendResponse(inChar);
+#ifdef HC_TX_STATS
+        if (_txStats[_txIndex].firstByteAt == 0) {
+          _txStats[_txIndex].firstByteAt = _clock->millis();
         }
-        Serial.println();
 #endif
-        if (verboseOut) {
-          Serial.print(" .");
+        if (_txFirmware != FIRM_VERSION2) {
+          // firmware version 1.x responses are not terminated. Module executes
+          //  command once it has been idle for FW1_CMD_IDLE, then sends complete
+          //  response without pause, so response is complete once line is idle.
+          _txState = TX_RECEIVE;
+          startWait(idleGap());
+          continue;
         }
-        // set to new baud rate and parity setting and test connection
-        Serial1.begin(baudRateList[baudRate], parityList[uartParity]);
-        delay(CONFIG_DELAY);
-        clearInputStream(firmware);
-        Serial1.print(command);
-        Serial1.flush();
-        responseDelay(command.length(), firmware, ECHO);
-        if (Serial1.available() > 0) {
-          comBuffer = Serial1.readString();
-#ifdef DEBUG
-          Serial.println();
-          Serial.println(comBuffer);
-          for (unsigned int i = 0; i < comBuffer.length(); i++) {
-            Serial.print("\t");
-            Serial.print(comBuffer.charAt(i), HEX);
+        // firmware version 2.x/3.x terminates response to each command with OK 
+        //  or ERROR status line. Timeout is restarted by each received character 
+        //  so that a partially received response is not cut off.
+        startWait(responseTime(_txCmdLength, _txFirmware, _txIndex));
+        if (inChar == '\n') {
+          switch (parseLine(_txResponse + _txLineStart, &value)) {
+            case LINE_OK:
+              _txStatus[_txReplies++] = HC_SUCCESS;
+              break;
+            case LINE_ERROR:
+              _txError[_txReplies] = errorCode(value);
+              _txStatus[_txReplies++] = HC_FAILED;
+              break;
+            case LINE_VALUE:
+              if (_op == HC_OP_READ_ALL)  storeProperty(_txResponse + _txLineStart, value);
+              break;
           }
-          Serial.println();
-#endif
-          // if OK response received, UART configuration found
-          if (comBuffer.startsWith(STATUS_OK)) {
-            firmVersion = firmware;
-            // firmware version 2.x/3.x might be hc-05 device
-            if (firmware == FIRM_VERSION2) {
-              // use getRole and setRole response to identify device model
-              switch (fetchRole(verboseOut)) {
-                case ROLE_SECONDARY:
-                    // hc-06 fw vers 2/3 will fail when attempting to set role
-                    if (changeRole(ROLE_SECONDARY, verboseOut)) {
-                      deviceModel = MODEL_HC05;
-                    } else {
-                      deviceModel = MODEL_HC06;
-                    }
-                    break;
-                case ROLE_PRIMARY:
-                case ROLE_SECONDARY_LOOP:
-                    deviceModel = MODEL_HC05;
-                    break;
-                default:
-                    deviceModel = MODEL_HC06;
-                    break;
-              }
-            } else {
-              deviceModel = MODEL_HC06;
-            }
+          _txLineStart = _txLength;
+          if (_txReplies >= _txCount) {
+            _txComplete = true;
+            _rxClean = true;
+            _txState = TX_DONE;
             break;
           }
         }
-        while (Serial1.available() > 0) {
-          // wait until input stream is clear
-          Serial1.read();
-        }
-        // end Test for Version x.x firmware
-        Serial1.end();
-        delay(CONFIG_DELAY);
-      } // end baud rate loop
-      if (VERSION_KNOWN)  break;
-    } // end parity loop
-    if (VERSION_KNOWN)  break;
-  } // end firmware loop
-  if (verboseOut) {
-    Serial.println();
+      }
+      if (_txState == TX_DONE)  break;
+      if (!waitDone())  return false;
+      _txComplete = (_txState == TX_RECEIVE);
+      _txState = TX_DONE;
+      break;
+    case TX_DONE:
+      return true;
+    default:
+      _txState = TX_DONE;
+      return true;
   }
-  // If configuration successfully determined, update firmware version string
-  fetchVersion(verboseOut);
-  if (verboseOut) {
-    if (VERSION_KNOWN) {
-      Serial.println("\nDevice identified . . .");
-      Serial.print("\tModel: "); 
-      Serial.println(responsePrefix[deviceModel] + versionString);
-      Serial.print("\tBaud rate: "); 
-      Serial.println(baudRateList[baudRate]);
-      Serial.print("\tParity: "); 
-      Serial.println(parityType[uartParity]);
-    } else {
-      Serial.println("\nDevice not identified. Check connections and try again.");
-    }
+  finishReplies();
+#ifdef HC_TX_STATS
+  recordStats();
+#endif
+#ifdef DEBUG
+  Serial.println();
+  Serial.println(_txResponse);
+  for (unsigned int i = 0; i < _txLength; i++) {
+    Serial.print("\t");
+    Serial.print(_txResponse[i], HEX);
   }
-  if (VERSION_UNKNOWN) {
-    // since last call is to Serial1.end(), set begun back to false
-    uartBegun = false;
+  Serial.println();
+#endif
+  return true;
+}
+
+void HCBT::appendResponse(char inChar) {
+  if (_txLength >= (HC_RESPONSE_BUFFER - 1)) {
+    // line exceeds capacity of buffer, drop character
+    if (_txLineStart == 0)  return;
+    // discard completed lines, keeping partial line received so far
+    _txLength -= _txLineStart;
+    memmove(_txResponse, _txResponse + _txLineStart, _txLength);
+    _txLineStart = 0;
   }
-  setDataMode();
-  return (VERSION_KNOWN);
+  _txResponse[_txLength++] = inChar;
+  _txResponse[_txLength] = '\0';
 }
 
-bool HCBT::testEcho(bool verboseOut) {
-  String comBuffer = "";
-  String command;
+bool HCBT::responseOK() {
+  return (strncmp(_txResponse, STATUS_OK, sizeof(STATUS_OK) - 1) == 0);
+}
 
-  setCommandMode();
-  command = atCommands[ECHO] + lineEnding[firmVersion];
-  clearInputStream(firmVersion);
-  Serial1.print(command);
-  Serial1.flush();
-  responseDelay(command.length(), firmVersion, ECHO);
-  if (Serial1.available() > 0) {
-    comBuffer = Serial1.readString();
-    if (verboseOut) {
-      Serial.print(responsePrefix[deviceModel]);
-      Serial.println(comBuffer);
-    }
-#ifdef DEBUG
-    for (unsigned int i = 0; i < comBuffer.length(); i++)
-    {
-      Serial.print("\t");
-      Serial.print(comBuffer.charAt(i), HEX);
+int HCBT::parseLine(const char *line, const char **value) {
+  const char *separator;
+
+  if (strncmp(line, STATUS_OK, sizeof(STATUS_OK) - 1) == 0)
+    return LINE_OK;
+  if (strncmp(line, STATUS_ERROR, sizeof(STATUS_ERROR) - 1) == 0) {
+    // code is enclosed in parentheses, preceded by ':' for most firmware
+    *value = line + sizeof(STATUS_ERROR) - 1;
+    if (**value == ':')   (*value)++;
+    if (**value == '(')   (*value)++;
+    return LINE_ERROR;
+  }
+  if (line[0] == '+') {
+    separator = strchr(line, ':');
+    if (separator != NULL) {
+      *value = separator + 1;
+      return LINE_VALUE;
     }
-    Serial.println();
-#endif
   }
-  if (!(comBuffer.startsWith(STATUS_OK))) {
-    if (verboseOut) {
-      Serial.println("OK response not received.");
+  return LINE_OTHER;
+}
+
+void HCBT::finishReplies() {
+  if ((_txFirmware != FIRM_VERSION2) && _txComplete) {
+    // firmware 1.x replies are not terminated by status line, and start with
+    //  OK if command succeeded
+    if (responseOK()) {
+      _txStatus[0] = HC_SUCCESS;
+    } else {
+      _txStatus[0] = HC_FAILED;
+      _txError[0] = HC_ERR_UNKNOWN;
     }
-    setDataMode();
-    initDevice();
+  }
+  for (int i = 0; i < _txCount; i++) {
+    if (_txStatus[i] == HC_IDLE)  _txError[i] = HC_ERR_TIMEOUT;
+  }
+}
+
+bool HCBT::retryTransaction() {
+  if ((_txFirmware != FIRM_VERSION2) || (_txCount != 1) || 
+        (_opRetries >= CMD_RETRY_MAX))
     return false;
+  if ((_txError[0] != HC_ERR_COMMAND) && (_txError[0] != HC_ERR_PSKEY_WRITE))
+    return false;
+  printResponse();
+  if (_opVerbose) {
+    Serial.println("Resending command.");
   }
-  setDataMode();
+  _opRetries++;
+  startTransaction(_txCommand, _txFirmware, _txIndex);
   return true;
 }
 
-int HCBT::fetchRole(bool verboseOut) {
-  String comBuffer = "";
-  String command;
-  int role;
-
-  if (VERSION_UNKNOWN)  
-    return ROLE_UNKNOWN;
-  setCommandMode();
-  command = String(ROLE_REQ);
-  clearInputStream(firmVersion);
-  Serial1.print(command);
-  Serial1.flush();
-  // response is OK, same as AT
-  responseDelay(command.length(), firmVersion, ECHO);
-  if (Serial1.available() > 0) {
-    comBuffer = Serial1.readString();
-    if (verboseOut) {
-      Serial.println("\nRequesting device role.");
-      Serial.print(responsePrefix[deviceModel]);
-      Serial.println(comBuffer);
-    }
-#ifdef DEBUG
-    for (unsigned int i = 0; i < comBuffer.length(); i++) {
-      Serial.print("\t");
-      Serial.print(comBuffer.charAt(i), HEX);
+HCReply HCBT::lastReply() {
+  HCReply reply;
+  int index = ((_txCount > 0) ? (_txCount - 1) : 0);
+
+  reply.status = _txStatus[index];
+  reply.error = _txError[index];
+  return reply;
+}
+
+HCReply HCBT::pipelineReply(int index) {
+  HCReply reply = {HC_IDLE, HC_ERR_NONE};
+
+  if ((index < 0) || (index >= _pipeCount) || !_pipeSent)
+    return reply;
+  reply.status = _pipeStatus[index];
+  reply.error = _pipeError[index];
+  return reply;
+}
+
+const __FlashStringHelper *HCBT::errorString(HCError error) {
+  if (error == HC_ERR_NONE)
+    return F("OK");
+  if (error == HC_ERR_TIMEOUT)
+    return F("No response");
+  if ((error < HC_ERR_COMMAND) || (error >= HC_ERR_UNKNOWN))
+    return F("Unrecognized response");
+  return flashStr(errorCodes, error);
+}
+
+#ifdef HC_TX_STATS
+void HCBT::recordStats() {
+  HCTxStats &stats = _txStats[_txIndex];
+  int outcome = HC_TX_OK;
+
+  stats.completeAt = _clock->millis();
+  for (int i = 0; i < _txCount; i++) {
+    if (_txError[i] == HC_ERR_TIMEOUT) {
+      outcome = HC_TX_TIMEOUT;
+    } else if ((_txError[i] != HC_ERR_NONE) && (outcome == HC_TX_OK)) {
+      outcome = HC_TX_ERROR;
     }
-    Serial.println();
-#endif
   }
-  role = comBuffer.indexOf(':');
-  if (role < 0) {
-    deviceRole = ROLE_UNKNOWN;
-  } else {
-    switch (comBuffer.charAt(role+1)) {
-      case '0': deviceRole = ROLE_SECONDARY;
-                break;
-      case '1': deviceRole = ROLE_PRIMARY;
-                break;
-      case '2': deviceRole = ROLE_SECONDARY_LOOP;
-                break;
-      default:  deviceRole = ROLE_UNKNOWN;
+  stats.lastOutcome = outcome;
+  stats.outcomes[outcome]++;
+  if (stats.writeAt != 0) {
+    unsigned long response = stats.completeAt - stats.writeAt;
+    if (response > stats.maxResponse)  stats.maxResponse = response;
+    stats.totalResponse += response;
+  }
+}
+
+const HCTxStats &HCBT::txStats(int command) {
+  if ((command < 0) || (command >= HC_CMD_CNT))  command = OTHER_CMD;
+  return _txStats[command];
+}
+
+void HCBT::resetTxStats() {
+  memset(_txStats, 0, sizeof(_txStats));
+}
+#endif
+
+bool HCBT::responseError() {
+  const char *code = _txResponse + sizeof(STATUS_ERROR) - 1;
+
+  if (strncmp(_txResponse, STATUS_ERROR, sizeof(STATUS_ERROR) - 1) != 0)
+    return false;
+  // code is enclosed in parentheses, preceded by ':' for most firmware
+  if (*code == ':')   code++;
+  return (*code == '(');
+}
+
+bool HCBT::responseGarbled() {
+  unsigned int okPos = 0;
+  unsigned int errorPos = 0;
+  bool okLine = true;
+  bool errorLine = true;
+  bool matched = false;
+
+  // correctly framed status is not garbled, though command was rejected
+  if (responseOK() || responseError())  return false;
+  // characters failing parity check are dropped, but those received are still
+  //  in order of OK or ERROR status. Any other character is noise, e.g. of a
+  //  mismatched baud rate
+  for (unsigned int i = 0; i < _txLength; i++) {
+    char c = _txResponse[i];
+    if ((c == '\r') || (c == '\n')) {
+      okPos = errorPos = 0;
+      okLine = errorLine = true;
+      continue;
     }
+    okLine = okLine && statusNext(garbledStatus[0], okPos, c);
+    errorLine = errorLine && statusNext(garbledStatus[1], errorPos, c);
+    if (!okLine && !errorLine)  return false;
+    matched = true;
   }
-  if (verboseOut) {
-    if (deviceRole == ROLE_UNKNOWN) {
-      Serial.println("Role response not identified.");
-    } else {
-      Serial.println("Device role is: " + roleString[deviceRole]);
+  return matched;
+}
+
+void HCBT::printResponse(bool blankLine) {
+  if (!_opVerbose || (_txLength == 0))  return;
+  Serial.print(flashStr(responsePrefix, deviceModel));
+  Serial.println(_txResponse);
+  for (int i = 0; i < _txReplies; i++) {
+    if ((_txError[i] >= HC_ERR_COMMAND) && (_txError[i] < HC_ERR_UNKNOWN)) {
+      Serial.print("\tError ");
+      Serial.println(errorString(_txError[i]));
     }
   }
-  setDataMode();
-  return deviceRole;
+  if (blankLine) {
+    Serial.println();
+  }
 }
 
-int HCBT::getRole(bool verboseOut) {
-  if (deviceRole == ROLE_UNKNOWN) {
-    return fetchRole(verboseOut);
+void HCBT::clearSerial() {
+  while (Serial.available() > 0) {
+    // wait until input stream is clear
+    Serial.read();
   }
-  return deviceRole;
 }
 
-bool HCBT::changeRole(int role, bool verboseOut) {
-  String comBuffer = "";
-  String command;
+void HCBT::clearInputStream() {
+  while (_uart->available() > 0) {
+    // wait until input stream is clear
+    _uart->read();
+  }
+}
 
-  command = String(ROLE_CMD) + role + lineEnding[FIRM_VERSION2];
-  if (verboseOut) {
-    Serial.print("Set role of HC05 to ");
-    Serial.println(roleString[role]);
+void HCBT::printMenu() {
+  Serial.println("\n");
+  Serial.write('\f');   // Form feed (not supported in Serial Monitor)
+  Serial.print(flashStr(responsePrefix, deviceModel));
+  Serial.println(versionString);
+  Serial.print("\tBaud rate: ");
+  Serial.println(baudRateList[baudRate]);
+  Serial.print("\tParity: ");
+  Serial.println(flashStr(parityType, uartParity));
+  Serial.println();
+  Serial.println("Select option:");
+  for (int i = 1; i < HC06_MENUSIZE; i++) {
+    Serial.print("\t(");
+    Serial.print(i);
+    Serial.println(flashStr(hc06Menu, i));
   }
-  setCommandMode();
-  clearInputStream(firmVersion);
-  Serial1.print(command);
-  Serial1.flush();
-  // response is OK, same as AT
-  responseDelay(command.length(), firmVersion, ECHO);
-  if (Serial1.available() > 0) {
-    comBuffer = Serial1.readString();
-    if (verboseOut) {
-      Serial.print(responsePrefix[deviceModel]);
-      Serial.println(comBuffer);
-    }
-#ifdef DEBUG
-    for (unsigned int i = 0; i < comBuffer.length(); i++)
-    {
-      Serial.print("\t");
-      Serial.print(comBuffer.charAt(i), HEX);
-    }
-    Serial.println();
-#endif
+  Serial.println();
+}
+
+void HCBT::startOperation(int operation, int step, bool verboseOut) {
+  _op = operation;
+  _opStep = step;
+  _opVerbose = verboseOut;
+  _opResult = HC_BUSY;
+  _opSuccess = true;
+  _opRetries = 0;
+  _txState = TX_IDLE;
+  // commands queued but not sent share _cmdBuffer, which other operations use
+  if ((operation != HC_OP_PIPELINE) && !_pipeSent)  _pipeCount = 0;
+  if (_sessionDepth == 0) {
+    // application may have written to Serial1 since last operation
+    _rxClean = false;
   }
-  if (!(comBuffer.startsWith(STATUS_OK))) {
-    if (verboseOut) {
-      Serial.println("Device role not set.");
-    }
-    //deviceRole = ROLE_UNKNOWN;  // don't modify role since it may be HC06
-    setDataMode();
-    return false;
+  startWait(0);
+}
+
+void HCBT::finishOperation(bool success, unsigned long holdMS) {
+  _opSuccess = (_opSuccess && success);
+  if (_opSuccess && VERSION_KNOWN) {
+    // detected or updated UART configuration is tested first by next detection
+    saveHint();
   }
-  deviceRole = role;
-  if (verboseOut) {
-    Serial.println("Device role set to: " + roleString[deviceRole]);
+  if ((_op == HC_OP_APPLY_CONFIG) && (_cfgResult.uart == HC_BUSY)) {
+    // UART configuration is last setting of applyConfig()
+    _cfgResult.uart = (success ? HC_SUCCESS : HC_FAILED);
+  }
+  if ((_op == HC_OP_APPLY_CONFIG) && _cfgCommit) {
+    // committed settings are no longer staged, failed settings remain staged
+    if (_cfgResult.name == HC_SUCCESS)  _staged &= ~HC_SNAP_NAME;
+    if (_cfgResult.pin == HC_SUCCESS)   _staged &= ~HC_SNAP_PIN;
+    if (_cfgResult.role == HC_SUCCESS)  _staged &= ~HC_SNAP_ROLE;
+    if (_cfgResult.uart == HC_SUCCESS)  _staged &= ~HC_SNAP_UART;
   }
-  setDataMode();
+  // HC-05 remains in command mode while a session is open
+  if ((_sessionDepth == 0) && switchMode(MODE_DATA) && (holdMS < SHORT_DELAY)) {
+    holdMS = SHORT_DELAY;
+  }
+  startWait(holdMS);
+  _opStep = STEP_FINISH;
+}
+
+bool HCBT::beginDetect(bool verboseOut) {
+  if (busy())   return false;
+  startOperation(HC_OP_DETECT, DETECT_START, verboseOut);
   return true;
 }
 
-bool HCBT::setRole(int role, bool verboseOut) {
-  if (VERSION_UNKNOWN)  
-    return false;
-  if ((role < ROLE_SECONDARY) || (role > ROLE_SECONDARY_LOOP))
-    return false;
-  if (deviceModel != MODEL_HC05) {
-    if (role == ROLE_SECONDARY)
-      return true;
-    else 
-      return false;
-  }
-  if (deviceRole == role) {
-    return true;
+bool HCBT::detectDevice(bool verboseOut) {
+  return (beginDetect(verboseOut) && waitOperation());
+}
+
+int HCBT::poll() {
+  if (_opResult != HC_BUSY)   return _opResult;
+  stepOperation();
+  if ((_opResult != HC_BUSY) && (_callback != NULL)) {
+    _callback(this, _op, (_opResult == HC_SUCCESS));
   }
-  return changeRole(role, verboseOut);
+  return _opResult;
 }
 
-void HCBT::setLocalBaud() {
-  String comBuffer = "";
-  String command;
+bool HCBT::busy() {
+  return (_opResult == HC_BUSY);
+}
 
-  clearSerial();
-  Serial.println("It is advised that baud rate is left at same setting as found hardware.");
-  Serial.print("Current baud rate: ");
-  Serial.println(baudRateList[baudRate]);
-  Serial.println("Select desired baud rate:");
-  Serial.println("\t(0) Cancel");
-  Serial.println("\t(1)---------1200");
-  Serial.println("\t(2)---------2400");
+int HCBT::operation() {
+  return _op;
+}
+
+void HCBT::setCallback(HCCallback callback) {
+  _callback = callback;
+}
+
+void HCBT::setClock(HCClock *clock) {
+  _clock = (clock != NULL) ? clock : &HCArduinoClock;
+  // EN/KEY pin is treated as settled
+  _modeSince = _clock->millis() - SHORT_DELAY;
+}
+
+bool HCBT::waitOperation() {
+  while (poll() == HC_BUSY) {
+    _clock->idle();
+  }
+  return (_opResult == HC_SUCCESS);
+}
+
+void HCBT::stepOperation() {
+  switch (_opStep) {
+    case STEP_FINISH:
+      if (!waitDone())  return;
+      _opStep = STEP_IDLE;
+      _opResult = (_opSuccess ? HC_SUCCESS : HC_FAILED);
+      return;
+    case STEP_TRANSACTION:
+      // single AT transaction of setName(), setPin() or setRole()
+      if (!pollTransaction() || retryTransaction())   return;
+      if (_op == HC_OP_SET_ROLE) {
+        finishOperation(finishChangeRole(_cfgRole));
+        return;
+      }
+      printResponse(true);
+      if (_txStatus[0] == HC_SUCCESS) {
+        if (_op == HC_OP_SET_NAME) {
+          strcpy(btName, _cfgName);
+        } else {
+          strcpy(btPin, _cfgPin);
+        }
+        finishOperation(true);
+      } else if (_op == HC_OP_SET_NAME) {
+        if (_opVerbose) {
+          Serial.println("Names above 14 characters fail for some FW Version 1.x baud settings.");
+          Serial.println("Try with alternate string less than 10 characters.");
+        }
+        finishOperation(false);
+      } else {
+        if (_opVerbose) {
+          Serial.println("Setting pin failed!");
+        }
+        finishOperation(false, (_opVerbose ? MENU_DELAY : 0));
+      }
+      return;
+    case FETCH_ROLE_WAIT:
+      if (!pollTransaction())   return;
+      finishFetchRole();
+      finishOperation(true);
+      return;
+    case FETCH_VERSION_WAIT:
+      if (!pollTransaction())   return;
+      if (finishFetchVersion()) {
+        finishOperation(true);
+      } else {
+        startEcho();
+        _opStep = FETCH_ECHO_WAIT;
+      }
+      return;
+    case FETCH_ECHO_WAIT:
+      if (!pollTransaction())   return;
+      finishOperation(finishEcho());
+      return;
+    case PIPELINE_WAIT:
+      if (!pollTransaction())   return;
+      printResponse(true);
+      finishPipeline();
+      return;
+    default:
+      break;
+  }
+  if (_op == HC_OP_DETECT) {
+    stepDetect();
+  } else if ((_op == HC_OP_CONFIG_UART) || (_op == HC_OP_PIPELINE)) {
+    // pipeline continues with reconfiguration of Serial1 following UART command
+    stepConfigUART();
+  } else if (_op == HC_OP_APPLY_CONFIG) {
+    if (_opStep >= APPLY_NEXT) {
+      stepApplyConfig();
+    } else {
+      stepConfigUART();
+    }
+  } else if (_op == HC_OP_READ_ALL) {
+    stepReadAll();
+  }
+}
+
+void HCBT::stepDetect() {
+  switch (_opStep) {
+    case DETECT_START:
+      initDevice();
+      if (_opVerbose) {
+        Serial.print("\nSearching for firmware and version of HC0x device");
+      }
+      startWait(0);
+      if (!uartBegun) {
+        // protect against board packages which do not check for Serial begun prior
+        //  to executing end()
+        _uart->begin(9600);
+        startWait(SHORT_DELAY);
+        uartBegun = true;
+      }
+      _opStep = DETECT_END_UART;
+      break;
+    case DETECT_END_UART:
+      if (!waitDone())  return;
+      _uart->end();
+      startWait(CONFIG_DELAY);
+      // Scan through possible UART configurations for each firmware version,
+      //  starting from hint. Use AT command to test for OK response.
+      memset(_probed, 0, sizeof(_probed));
+      _probeStep = 0;
+      _parityChecks = 0;
+      _probeCount = 0;
+      _guessCnt = 0;
+      _guessStep = 0;
+      nextProbe();
+      _opStep = DETECT_BEGIN_UART;
+      break;
+    case DETECT_BEGIN_UART:
+      if (!waitDone())  return;
+      if (_opVerbose) {
+        Serial.print(" .");
+      }
+      // set to new baud rate and parity setting and test connection
+      _uart->begin(baudRateList[baudRate], parityList[uartParity]);
+      _rxClean = false;
+      startWait(CONFIG_DELAY);
+      _opStep = DETECT_PROBE;
+      break;
+    case DETECT_PROBE:
+      if (!waitDone())  return;
+      // fw 1.x merges bare AT with characters received within FW1_CMD_IDLE 
+      //  (e.g. CRLF of previous probe, garbled at other baud rate), so line 
+      //  is held idle until they have been discarded
+      if ((_scanFirmware == FIRM_VERSION1) && _txSent &&
+            ((_clock->millis() - _txSentAt) < (FW1_CMD_IDLE + idleGap()))) {
+        startWait(FW1_CMD_IDLE + idleGap() - (_clock->millis() - _txSentAt));
+        return;
+      }
+      // Test for Version x.x firmware AT echo
+      AT_FORMAT(ECHO, _scanFirmware, _cmdBuffer);
+      startTransaction(_cmdBuffer, _scanFirmware, ECHO);
+      _probeCount++;
+      _opStep = DETECT_PROBE_WAIT;
+      break;
+    case DETECT_PROBE_WAIT:
+      if (!pollTransaction())   return;
+      // characters received at wrong baud rate indicate actual baud rate
+      if (!responseOK() && !responseError() && !responseGarbled()) {
+        estimateBaud();
+      }
+      // if OK response received, UART configuration found
+      if (responseOK()) {
+        firmVersion = _txFirmware;
+        if (_opVerbose) {
+          Serial.println();
+        }
+        // firmware version 2.x/3.x might be hc-05 device
+        if (firmVersion == FIRM_VERSION2) {
+          // use getRole and setRole response to identify device model
+          startFetchRole();
+          _opStep = DETECT_ROLE;
+        } else {
+          deviceModel = MODEL_HC06;
+          startFetchVersion();
+          _opStep = DETECT_VERSION;
+        }
+        break;
+      }
+      // well-formed ERROR status means baud rate matches, and parity matches 
+      //  if command was only corrupted (e.g. by characters of earlier probes),
+      //  so probe again. A receiver without parity check also accepts reply 
+      //  of module using parity, so ERROR status repeated identifies only baud.
+      if (responseError() && (_opRetries < CMD_RETRY_MAX)) {
+        _opRetries++;
+        _rxClean = true;
+        AT_FORMAT(ECHO, FIRM_VERSION2, _cmdBuffer);
+        startTransaction(_cmdBuffer, FIRM_VERSION2, ECHO);
+        _probeCount++;
+        return;
+      }
+      _opRetries = 0;
+      // reply garbled by parity mismatch identifies baud rate, so test other
+      //  parity settings at this baud rate next
+      if ((responseGarbled() || responseError()) && (_parityChecks == 0)) {
+        _parityChecks = PARITY_LIST_CNT - 1;
+        _garbledParity = uartParity;
+      }
+      clearInputStream();
+      // end Test for Version x.x firmware
+      _uart->end();
+      startWait(CONFIG_DELAY);
+      if (nextProbe()) {
+        _opStep = DETECT_BEGIN_UART;
+        break;
+      }
+      initDevice();
+      if (_opVerbose) {
+        Serial.println();
+        Serial.println("\nDevice not identified. Check connections and try again.");
+      }
+      // since last call is to _uart->end(), set begun back to false
+      uartBegun = false;
+      finishOperation(false);
+      break;
+    case DETECT_ROLE:
+      if (!pollTransaction())   return;
+      switch (finishFetchRole()) {
+        case ROLE_SECONDARY:
+            if ((_hintFirmware == FIRM_VERSION2) && (_hintModel != MODEL_UNKNOWN)) {
+              // may be same device as last detected, so hinted model is 
+              //  confirmed by version string before address is requested
+              break;
+            }
+            // hc-06 fw vers 2/3 does not answer address request
+            startFetchModel();
+            _opStep = DETECT_MODEL;
+            return;
+        case ROLE_PRIMARY:
+        case ROLE_SECONDARY_LOOP:
+            deviceModel = MODEL_HC05;
+            break;
+        default:
+            deviceModel = MODEL_HC06;
+            break;
+      }
+      startFetchVersion();
+      _opStep = DETECT_VERSION;
+      break;
+    case DETECT_MODEL:
+      if (!pollTransaction())   return;
+      finishFetchModel();
+      // version already read if model was requested to confirm hint, so 
+      //  detection completes below (transaction remains done)
+      if (versionString[0] == '\0') {
+        startFetchVersion();
+        _opStep = DETECT_VERSION;
+        break;
+      }
+      // fall through
+    case DETECT_VERSION:
+    case DETECT_ECHO:
+      if (!pollTransaction())   return;
+      // If configuration successfully determined, update firmware version string
+      if ((_opStep == DETECT_VERSION) && !finishFetchVersion()) {
+        startEcho();
+        _opStep = DETECT_ECHO;
+        break;
+      }
+      if (_opStep == DETECT_ECHO) {
+        finishEcho();
+      }
+      if (VERSION_KNOWN && (deviceModel == MODEL_UNKNOWN)) {
+        // hinted model is only reused if version string has format of that 
+        //  model, since another device may answer at hinted settings
+        if (versionModel() == _hintModel) {
+          deviceModel = _hintModel;
+        } else {
+          startFetchModel();
+          _opStep = DETECT_MODEL;
+          break;
+        }
+      }
+      if (_opVerbose) {
+        if (VERSION_KNOWN) {
+          Serial.println("\nDevice identified . . .");
+          Serial.print("\tModel: ");
+          Serial.print(flashStr(responsePrefix, deviceModel));
+          Serial.println(versionString);
+          Serial.print("\tBaud rate: ");
+          Serial.println(baudRateList[baudRate]);
+          Serial.print("\tParity: ");
+          Serial.println(flashStr(parityType, uartParity));
+        } else {
+          Serial.println("\nDevice not identified. Check connections and try again.");
+        }
+      }
+      finishOperation(VERSION_KNOWN);
+      break;
+  }
+}
+
+bool HCBT::nextProbe() {
+  const int baudCnt = BAUD_LIST_CNT - VERS2_MIN_BAUD;
+  int firmware, baud, parity;
+
+  // targeted parity checks at baud rate of garbled reply
+  while (_parityChecks > 0) {
+    parity = (_garbledParity + _parityChecks--) % PARITY_LIST_CNT;
+    if (claimProbe(_scanFirmware, baudRate, parity))  return true;
+  }
+  // baud rates estimated from mis-framed response
+  while (_guessStep < _guessCnt) {
+    if (claimProbe(_guessFirmware, _baudGuess[_guessStep++], _guessParity))
+      return true;
+  }
+  while (_probeStep < (int)(HINT_PROBE_CNT + SCAN_PASS_CNT * baudCnt)) {
+    int step = _probeStep++;
+    if (step < (int)HINT_PROBE_CNT) {
+      if (_hintFirmware == FIRM_UNKNOWN)  continue;
+      baud = _hintBaud + hintOffsets[step][0];
+      parity = (_hintParity + hintOffsets[step][1]) % PARITY_LIST_CNT;
+      firmware = (hintOffsets[step][2] == 0) ? _hintFirmware 
+                      : (FIRM_VERSION1 + FIRM_VERSION2 - _hintFirmware);
+      if ((baud < VERS2_MIN_BAUD) || (baud >= BAUD_LIST_CNT))  continue;
+    } else {
+      // full scan: passes of scanPasses, each with baud rate upward.
+      //  firmware version 2.x/3.x does not support baud rate below 4800, and
+      //  firmware 1.x currently only supports min baud of 4800 to avoid conflict
+      //  with devices which only implement UART min of 4800
+      step -= HINT_PROBE_CNT;
+      firmware = scanPasses[step / baudCnt][0];
+      parity = scanPasses[step / baudCnt][1];
+      baud = VERS2_MIN_BAUD + (step % baudCnt);
+    }
+    if (claimProbe(firmware, baud, parity))  return true;
+  }
+  return false;
+}
+
+bool HCBT::claimProbe(int firmware, int baud, int parity) {
+  int cell = ((FIRM_VERSION2 - firmware) * PARITY_LIST_CNT + parity) 
+                * (BAUD_LIST_CNT - VERS2_MIN_BAUD) + (baud - VERS2_MIN_BAUD);
+
+  if (_probed[cell / 8] & (1 << (cell % 8)))  return false;
+  _probed[cell / 8] |= (1 << (cell % 8));
+  _scanFirmware = firmware;
+  baudRate = baud;
+  uartParity = parity;
+  return true;
+}
+
+void HCBT::estimateBaud() {
+  const int baudCnt = BAUD_LIST_CNT - VERS2_MIN_BAUD;
+  uint8_t score[BAUD_LIST_CNT - VERS2_MIN_BAUD];
+  int best;
+
+  // keep estimate until its baud rates have been tested
+  if ((_txLength == 0) || (_guessStep < _guessCnt))  return;
+  for (int baud = 0; baud < baudCnt; baud++) {
+    score[baud] = 0;
+    for (int status = 0; status < MISFRAMED_STATUS_CNT; status++) {
+      const uint8_t *expected = misframedStatus[baudRate - VERS2_MIN_BAUD][baud][status];
+      uint8_t count = pgm_read_byte(expected);
+      uint8_t matched = 0;
+      for (unsigned int i = 0; (i < count) && (i < _txLength); i++) {
+        if ((uint8_t)_txResponse[i] == pgm_read_byte(expected + 1 + i))  matched++;
+      }
+      if (matched > score[baud])  score[baud] = matched;
+    }
+  }
+  // rank baud rates with any matching characters, best match first
+  _guessCnt = 0;
+  _guessStep = 0;
+  _guessFirmware = _scanFirmware;
+  _guessParity = uartParity;
+  do {
+    best = -1;
+    for (int baud = 0; baud < baudCnt; baud++) {
+      if ((score[baud] > 0) && ((best < 0) || (score[baud] > score[best])))
+        best = baud;
+    }
+    if (best >= 0) {
+      _baudGuess[_guessCnt++] = VERS2_MIN_BAUD + best;
+      score[best] = 0;
+    }
+  } while (best >= 0);
+}
+
+void HCBT::saveHint() {
+  if ((_hintFirmware == firmVersion) && (_hintBaud == baudRate) && 
+        (_hintParity == uartParity) && (_hintModel == deviceModel))
+    return;
+  _hintFirmware = firmVersion;
+  _hintBaud = baudRate;
+  _hintParity = uartParity;
+  _hintModel = deviceModel;
+#ifdef HC_EEPROM_HINT
+  if (_hintAddress >= 0) {
+    EEPROM.update(_hintAddress, HINT_MAGIC);
+    EEPROM.update(_hintAddress + 1, _hintFirmware);
+    EEPROM.update(_hintAddress + 2, _hintBaud);
+    EEPROM.update(_hintAddress + 3, _hintParity);
+    EEPROM.update(_hintAddress + 4, _hintModel);
+  }
+#endif
+}
+
+void HCBT::setDetectHint(unsigned long baud, int parity) {
+  for (int i = VERS2_MIN_BAUD; i < BAUD_LIST_CNT; i++) {
+    if ((baud == baudRateList[i]) && (parity >= NOPARITY) && (parity <= EVENPARITY)) {
+      // other firmware version is tested at same configuration if needed
+      _hintFirmware = FIRM_VERSION2;
+      _hintBaud = i;
+      _hintParity = parity;
+      _hintModel = MODEL_UNKNOWN;
+      return;
+    }
+  }
+}
+
+bool HCBT::useEEPROMHint(int address) {
+#ifdef HC_EEPROM_HINT
+  _hintAddress = address;
+  if ((EEPROM.read(address) != HINT_MAGIC) || 
+        (EEPROM.read(address + 1) < FIRM_VERSION1) || 
+        (EEPROM.read(address + 1) > FIRM_VERSION2) ||
+        (EEPROM.read(address + 2) < VERS2_MIN_BAUD) || 
+        (EEPROM.read(address + 2) >= BAUD_LIST_CNT) ||
+        (EEPROM.read(address + 3) >= PARITY_LIST_CNT))
+    return false;
+  _hintFirmware = EEPROM.read(address + 1);
+  _hintBaud = EEPROM.read(address + 2);
+  _hintParity = EEPROM.read(address + 3);
+  // model is identified again if not stored (hint of earlier library version)
+  _hintModel = EEPROM.read(address + 4);
+  if ((_hintModel != MODEL_HC06) && (_hintModel != MODEL_HC05))
+    _hintModel = MODEL_UNKNOWN;
+  return true;
+#else
+  (void)address;
+  return false;
+#endif
+}
+
+unsigned int HCBT::detectProbes() {
+  return _probeCount;
+}
+
+void HCBT::startEcho() {
+  AT_FORMAT(ECHO, firmVersion, _cmdBuffer);
+  startTransaction(_cmdBuffer, firmVersion, ECHO);
+}
+
+bool HCBT::finishEcho() {
+  printResponse();
+  if (_txStatus[0] != HC_SUCCESS) {
+    if (_opVerbose) {
+      Serial.println("OK response not received.");
+    }
+    initDevice();
+    return false;
+  }
+  return true;
+}
+
+void HCBT::startFetchRole() {
+  // response is OK, same as AT
+  startTransaction(ROLE_REQ, firmVersion, ECHO);
+}
+
+int HCBT::finishFetchRole() {
+  const char *role;
+
+  if (_opVerbose && (_txLength > 0)) {
+    Serial.println("\nRequesting device role.");
+  }
+  printResponse();
+  role = strchr(_txResponse, ':');
+  if (role == NULL) {
+    deviceRole = ROLE_UNKNOWN;
+  } else {
+    switch (role[1]) {
+      case '0': deviceRole = ROLE_SECONDARY;
+                break;
+      case '1': deviceRole = ROLE_PRIMARY;
+                break;
+      case '2': deviceRole = ROLE_SECONDARY_LOOP;
+                break;
+      default:  deviceRole = ROLE_UNKNOWN;
+    }
+  }
+  if (_opVerbose) {
+    if (deviceRole == ROLE_UNKNOWN) {
+      Serial.println("Role response not identified.");
+    } else {
+      Serial.print("Device role is: ");
+      Serial.println(flashStr(roleString, deviceRole));
+    }
+  }
+  return deviceRole;
+}
+
+void HCBT::startChangeRole(int role) {
+  if (_opVerbose) {
+    Serial.print("Set role of HC05 to ");
+    Serial.println(flashStr(roleString, role));
+  }
+  AtCmd<ROLE_SET, FIRM_VERSION2>::format(_cmdBuffer, (long)role);
+  startTransaction(_cmdBuffer, firmVersion, ROLE_SET);
+}
+
+bool HCBT::finishChangeRole(int role) {
+  printResponse();
+  if (_txStatus[0] != HC_SUCCESS) {
+    if (_opVerbose) {
+      Serial.println("Device role not set.");
+    }
+    //deviceRole = ROLE_UNKNOWN;  // don't modify role since it may be HC06
+    return false;
+  }
+  deviceRole = role;
+  if (_opVerbose) {
+    Serial.print("Device role set to: ");
+    Serial.println(flashStr(roleString, deviceRole));
+  }
+  return true;
+}
+
+void HCBT::startFetchModel() {
+  AtCmd<ADDR_GET, FIRM_VERSION2>::format(_cmdBuffer);
+  startTransaction(_cmdBuffer, firmVersion, ADDR_GET);
+}
+
+int HCBT::finishFetchModel() {
+  if (_opVerbose && (_txLength > 0)) {
+    Serial.println("\nRequesting device address.");
+  }
+  printResponse();
+  deviceModel = (_txStatus[0] == HC_SUCCESS) ? MODEL_HC05 : MODEL_HC06;
+  return deviceModel;
+}
+
+int HCBT::getRole(bool verboseOut) {
+  if ((deviceRole == ROLE_UNKNOWN) && VERSION_KNOWN && !busy()) {
+    startOperation(HC_OP_GET_ROLE, FETCH_ROLE_WAIT, verboseOut);
+    startFetchRole();
+    waitOperation();
+  }
+  return deviceRole;
+}
+
+bool HCBT::beginSetRole(int role, bool verboseOut) {
+  if (VERSION_UNKNOWN || busy())
+    return false;
+  if ((role < ROLE_SECONDARY) || (role > ROLE_SECONDARY_LOOP))
+    return false;
+  if ((deviceModel != MODEL_HC05) && (role != ROLE_SECONDARY))
+    return false;
+  if ((deviceModel != MODEL_HC05) || (deviceRole == role)) {
+    // HC-06 always acts as secondary, and role already set for HC-05
+    startOperation(HC_OP_SET_ROLE, STEP_FINISH, verboseOut);
+    return true;
+  }
+  _cfgRole = role;
+  startOperation(HC_OP_SET_ROLE, STEP_TRANSACTION, verboseOut);
+  startChangeRole(role);
+  return true;
+}
+
+bool HCBT::setRole(int role, bool verboseOut) {
+  return (beginSetRole(role, verboseOut) && waitOperation());
+}
+
+void HCBT::setLocalBaud() {
+  String comBuffer = "";
+  String command;
+
+  clearSerial();
+  Serial.println("It is advised that baud rate is left at same setting as found hardware.");
+  Serial.print("Current baud rate: ");
+  Serial.println(baudRateList[baudRate]);
+  Serial.println("Select desired baud rate:");
+  Serial.println("\t(0) Cancel");
+  Serial.println("\t(1)---------1200");
+  Serial.println("\t(2)---------2400");
   Serial.println("\t(3)---------4800");
   Serial.println("\t(4)---------9600 (Default)");
   Serial.println("\t(5)---------19200");
@@ -503,15 +1312,16 @@ void HCBT::setLocalBaud() {
     if (!uartBegun) {
       // protect against board packages which do not check for Serial begun prior
       //  to executing end()
-      Serial1.begin(9600);
-      delay(SHORT_DELAY);
+      _uart->begin(9600);
+      _clock->delay(SHORT_DELAY);
       uartBegun = true;
     }
-    Serial1.end();
-    delay(CONFIG_DELAY);
+    _uart->end();
+    _clock->delay(CONFIG_DELAY);
     baudRate = tempBaud;
-    Serial1.begin(baudRateList[baudRate], parityList[uartParity]);
-    delay(CONFIG_DELAY);
+    _uart->begin(baudRateList[baudRate], parityList[uartParity]);
+    _rxClean = false;
+    _clock->delay(CONFIG_DELAY);
     Serial.print("Set local baud rate to ");
     Serial.println(baudRateList[baudRate]);
 //    Serial.println("Testing new baud configuration . . .");
@@ -528,7 +1338,7 @@ void HCBT::setLocalParity() {
   clearSerial();
   Serial.println("It is advised that parity is left at same setting as found hardware.");
   Serial.print("Current parity: ");
-  Serial.println(parityType[uartParity]);
+  Serial.println(flashStr(parityType, uartParity));
   Serial.println("Select parity option:");
   Serial.println("\t(0) Cancel");
   Serial.println("\t(1).......No parity");
@@ -545,16 +1355,19 @@ void HCBT::setLocalParity() {
     if (!uartBegun) {
       // protect against board packages which do not check for Serial begun prior
       //  to executing end()
-      Serial1.begin(9600);
-      delay(SHORT_DELAY);
+      _uart->begin(9600);
+      _clock->delay(SHORT_DELAY);
       uartBegun = true;
     }
-    Serial1.end();
-    delay(CONFIG_DELAY);
+    _uart->end();
+    _clock->delay(CONFIG_DELAY);
     uartParity = tempParity;
-    Serial.println("Setting to " + parityType[uartParity] + " Parity check");
-    Serial1.begin(baudRateList[baudRate], parityList[uartParity]);
-    delay(CONFIG_DELAY);
+    Serial.print("Setting to ");
+    Serial.print(flashStr(parityType, uartParity));
+    Serial.println(" Parity check");
+    _uart->begin(baudRateList[baudRate], parityList[uartParity]);
+    _rxClean = false;
+    _clock->delay(CONFIG_DELAY);
 //    Serial.println("Testing new parity configuration . . .");
 //    testEcho();
   } else {
@@ -563,59 +1376,44 @@ void HCBT::setLocalParity() {
 }
 
 String HCBT::getVersionString(bool verboseOut) {
-  if (versionString.equals(""))
-    return fetchVersion(verboseOut);
+  if (versionString[0] == '\0') {
+    if (VERSION_KNOWN && !busy()) {
+      startOperation(HC_OP_GET_VERSION, FETCH_VERSION_WAIT, verboseOut);
+      startFetchVersion();
+      waitOperation();
+    }
+    return String(versionString);
+  }
   if (verboseOut) {
-    Serial.print(responsePrefix[deviceModel]);
+    Serial.print(flashStr(responsePrefix, deviceModel));
     Serial.println(versionString);
   }
-  return versionString;
+  return String(versionString);
 }
 
-String HCBT::fetchVersion(bool verboseOut) {
-  String comBuffer = "";
-  String command;
+void HCBT::startFetchVersion() {
+  AT_FORMAT(HCVERSION, firmVersion, _cmdBuffer);
+  startTransaction(_cmdBuffer, firmVersion, HCVERSION);
+}
 
-  if (VERSION_UNKNOWN) 
-    return "";
-  setCommandMode();
-  command = atCommands[HCVERSION] + requestVal[firmVersion];
-  clearInputStream(firmVersion);
-  Serial1.print(command);
-  Serial1.flush();
-  responseDelay(command.length(), firmVersion, HCVERSION);
-  if (Serial1.available() > 0) {
-    comBuffer = Serial1.readString();
-    if (verboseOut) {
-      Serial.print(responsePrefix[deviceModel]);
-      Serial.println(comBuffer);
-      Serial.println();
-    }
-    int nlChar = comBuffer.indexOf('\n');
-    int retChar = comBuffer.indexOf('\r');
-    int minChar = (nlChar < retChar ? nlChar : retChar);
-    if (minChar > 0) {
-      comBuffer.remove(minChar);
-    }
-    versionString = comBuffer;
-#ifdef DEBUG
-    for (unsigned int i = 0; i < comBuffer.length(); i++)
-    {
-      Serial.print("\t");
-      Serial.print(comBuffer.charAt(i), HEX);
-    }
-    Serial.println();
-#endif
-  } else {
-    testEcho(verboseOut);
+bool HCBT::finishFetchVersion() {
+  unsigned int i;
+
+  if (_txLength == 0)  return false;
+  printResponse(true);
+  // version string is first line of response
+  for (i = 0; (i < _txLength) && (i < (HC_VERSION_BUFFER - 1)); i++) {
+    if ((_txResponse[i] == '\r') || (_txResponse[i] == '\n'))  break;
+    versionString[i] = _txResponse[i];
   }
-  setDataMode();
-  return versionString;
+  versionString[i] = '\0';
+  return true;
 }
 
-String HCBT::constructUARTstring(unsigned long baud, int parity, int stops) {
-  return String(UART_CMD) + baud + "," + stops + "," 
-            + (parity) + lineEnding[FIRM_VERSION2];
+int HCBT::versionModel() {
+  if (versionString[0] == '\0')  return MODEL_UNKNOWN;
+  return (strncmp(versionString, VERSION_HC05, sizeof(VERSION_HC05) - 1) == 0) ?
+              MODEL_HC05 : MODEL_HC06;
 }
 
 void HCBT::selectBaudRate() {
@@ -642,87 +1440,12 @@ void HCBT::selectBaudRate() {
   if (tempBaud < 0) {
     Serial.println("Canceled");
   } else if (tempBaud < BAUD_LIST_CNT) {
-    configUART(baudRateList[tempBaud], uartParity, true);
+    menuResult(beginConfigUART(baudRateList[tempBaud], uartParity, true));
   } else {
     Serial.println("Invalid entry");
   }
 }
 
-bool HCBT::setBaudRate(int newBaud, bool verboseOut) {
-  String comBuffer = "";
-  String command;
-
-  if (VERSION_UNKNOWN) 
-    return false;
-  if (newBaud > BAUD_LIST_CNT) {
-    if (verboseOut) {
-      Serial.println("\nBaud rates above 115200 not supported.");
-      Serial.println("See docmentation for valid index values.");
-      delay(MENU_DELAY);
-    }
-    return false;
-  }
-  newBaud -= 1;
-  // construct AT command for UART configuration based on firmware version
-  if (firmVersion == FIRM_VERSION2) {
-    // firmware version 3.x does not support baud rate below 4800
-    if (newBaud < VERS2_MIN_BAUD) {
-      if (verboseOut) {
-        Serial.println("\nBaud rates below 4800 not supported by this firmware.");
-        delay(MENU_DELAY);
-      }
-      return false;
-    }
-    command = constructUARTstring(newBaud, uartParity, stopBits);
-  } else {
-    command = String(BAUD_CMD) + (newBaud+1) + lineEnding[firmVersion];
-  }
-  if (verboseOut) {
-    Serial.print("Setting HC06 and local baud rate to ");
-    Serial.println(baudRateList[newBaud]);
-    Serial.println("\tsending command: " + command);
-    Serial.println();
-  }
-  setCommandMode();
-  clearInputStream(firmVersion);
-  Serial1.print(command);
-  Serial1.flush();
-  responseDelay(command.length(), firmVersion, BAUD_SET);
-  if (Serial1.available() > 0) {
-    comBuffer = Serial1.readString();
-    if (verboseOut) {
-      Serial.print(responsePrefix[deviceModel]);
-      Serial.println(comBuffer);
-      Serial.println();
-    }
-#ifdef DEBUG
-    for (unsigned int i = 0; i < comBuffer.length(); i++) {
-      Serial.print("\t");
-      Serial.print(comBuffer.charAt(i), HEX);
-    }
-    Serial.println();
-#endif
-  }
-  if (!(comBuffer.startsWith(STATUS_OK))) {
-    if (verboseOut) {
-      Serial.println("\nRequest failed.");
-      delay(MENU_DELAY);
-    }
-    setDataMode();
-    return false;
-  }
-  // if OK response received, change Serial1 UART settings to match HC-xx
-  Serial1.end();
-  baudRate = newBaud;
-  delay(CONFIG_DELAY);
-  Serial1.begin(baudRateList[baudRate], parityList[uartParity]);
-  delay(CONFIG_DELAY);
-  if (verboseOut) {
-    Serial.println("Testing new baud rate configuration . . .");
-  }
-  return testEcho(verboseOut);
-}
-
 void HCBT::changeName() {
   String nameBT;
   int maxChars = 15;
@@ -734,78 +1457,81 @@ void HCBT::changeName() {
   }
   clearSerial();
   Serial.print("Enter BT name (max "); Serial.print(maxChars);
-  Serial.println(" characters - prepends " + namePrefix[deviceModel] + "): ");
+  Serial.print(" characters - prepends ");
+  Serial.print(flashStr(namePrefix, deviceModel));
+  Serial.println("): ");
 
   while (Serial.available() < 1);
   nameBT = Serial.readString();
   nameBT.trim();  // remove leading or trailing whitespaces (newline characters)
   if (nameBT.length() > 0) {
     // prepend user provided string with HC0x_ to produce max 20 character name
-    nameBT = namePrefix[deviceModel] + nameBT.substring(0, maxChars);
-    setName(nameBT, true);
+    nameBT = String(flashStr(namePrefix, deviceModel)) + nameBT.substring(0, maxChars);
+    menuResult(beginSetName(nameBT, true));
   } else {
     Serial.println("Invalid entry (empty string)");
   }
 }
 
-bool HCBT::setName(String newName, bool verboseOut) {
-  String comBuffer = "";
-  String command;
+bool HCBT::nameCommand(const char *newName, char *name, char *command, bool verboseOut) {
+  unsigned int maxChars = HC_NAME_MAX;
 
-  if (VERSION_UNKNOWN) 
-    return false;
-  if (newName.length() > 0) {
-    // Some devices with firmware version 1.x exhibited failures when trying to 
-    //  set name to more than 14 characters at baud rates > 19200.
-    if ((firmVersion == FIRM_VERSION1) && (baudRate > 4)) {
-      btName = newName.substring(0, 14);
-    } else {
-      btName = newName.substring(0, 20);
-    }
-    if (verboseOut) {
-      Serial.print("Setting name to ");
-      Serial.println(btName);
-    }
-    command = atCommands[BTNAME] + setValue[firmVersion] + btName + lineEnding[firmVersion];
-    setCommandMode();
-#ifdef DEBUG
-    Serial.println("\tsending command: " + command);
-#endif
-    clearInputStream(firmVersion);
-    Serial1.print(command);
-    Serial1.flush();
-    responseDelay(command.length(), firmVersion, BTNAME);
-    if (Serial1.available() > 0) {
-      comBuffer = Serial1.readString();
-      if (verboseOut) {
-        Serial.print(responsePrefix[deviceModel]);
-        Serial.println(comBuffer);
-        Serial.println();
-      }
-#ifdef DEBUG
-      for (unsigned int i = 0; i < comBuffer.length(); i++) {
-        Serial.print("\t");
-        Serial.print(comBuffer.charAt(i), HEX);
-      }
-      Serial.println();
-#endif
-    }
-    if (!(comBuffer.startsWith(STATUS_OK))) {
-      if (verboseOut) {
-        Serial.println("Names above 14 characters fail for some FW Version 1.x baud settings.");
-        Serial.println("Try with alternate string less than 10 characters.");
-      }
-      setDataMode();
-      return false;
-    }
-  } else {
+  if (newName[0] == '\0') {
     if (verboseOut) {
       Serial.println("Invalid entry (empty string)");
     }
     return false;
   }
-  setDataMode();
-  return true;
+  // Some devices with firmware version 1.x exhibited failures when trying to
+  //  set name to more than 14 characters at baud rates > 19200.
+  if ((firmVersion == FIRM_VERSION1) && (baudRate > 4)) {
+    maxChars = 14;
+  }
+  if (name != newName) {
+    strncpy(name, newName, maxChars);
+  }
+  name[maxChars] = '\0';
+  AT_FORMAT(BTNAME, firmVersion, command, name);
+#ifdef DEBUG
+  Serial.print("\tsending command: ");
+  Serial.println(command);
+#endif
+  return true;
+}
+
+bool HCBT::beginSetName(String newName, bool verboseOut) {
+  if (VERSION_UNKNOWN || busy())
+    return false;
+  if (!nameCommand(newName.c_str(), _cfgName, _cmdBuffer, verboseOut))
+    return false;
+  // name written directly replaces staged name, which shares _cfgName
+  _staged &= ~HC_SNAP_NAME;
+  if (strcmp(_cfgName, btName) == 0) {
+    // device already uses name, no write required
+    startOperation(HC_OP_SET_NAME, STEP_FINISH, verboseOut);
+    return true;
+  }
+  if (verboseOut) {
+    Serial.print("Setting name to ");
+    Serial.println(_cfgName);
+  }
+  startOperation(HC_OP_SET_NAME, STEP_TRANSACTION, verboseOut);
+  startTransaction(_cmdBuffer, firmVersion, BTNAME);
+  return true;
+}
+
+bool HCBT::setName(String newName, bool verboseOut) {
+  return (beginSetName(newName, verboseOut) && waitOperation());
+}
+
+void HCBT::menuResult(bool started) {
+  // rejected entry is shown for a while before menu is printed again. Only the
+  //  interactive menu waits, begin*() calls return at once.
+  if (started) {
+    waitOperation();
+  } else {
+    _clock->delay(MENU_DELAY);
+  }
 }
 
 void HCBT::changePin() {
@@ -821,39 +1547,32 @@ void HCBT::changePin() {
   while (Serial.available() < 1);
   pin = Serial.readString();
   pin.trim();
-  setPin(pin, true);
+  menuResult(beginSetPin(pin, true));
 }
 
-bool HCBT::setPin(String newPin, bool verboseOut) {
-  String comBuffer = "";
-  String command;
+bool HCBT::pinCommand(const char *newPin, char *command, bool verboseOut) {
+  unsigned int length = strlen(newPin);
 
-  if (VERSION_UNKNOWN) 
-    return false;
   if (firmVersion == FIRM_VERSION2) {
     // TODO is there a min length for FW 3.x pin?
-    if (newPin.length() < 1) {
+    if (length < 1) {
       if (verboseOut) {
         Serial.println("\nInvalid entry (too few characters)");
-        delay(MENU_DELAY);
       }
       return false;
     }
-    // version 3.x FW appears to require quotes around passkey,
-    //  though this isn't indicated in documentation
-    //  https://forum.arduino.cc/t/password-hc-05/481294
-    newPin = String("\"") + newPin.substring(0, 14) + String("\"");
-  } else if (newPin.length() == 4) {
+    // passkey is quoted by AtCmd<BTPSWD, FIRM_VERSION2>
+    AtCmd<BTPSWD, FIRM_VERSION2>::format(command, newPin, HC_PIN_MAX);
+  } else if (length == 4) {
     // for firware version 1.x, verify 4 numeric characters received
     for (unsigned int i = 0; i < 4; i++) {
-      if (!isDigit(newPin.charAt(i))) {
+      if (!isDigit(newPin[i])) {
         if (verboseOut) {
           Serial.println("\nInvalid entry (not 4-digit integer)");
-          delay(MENU_DELAY);
         }
 #ifdef DEBUG
         Serial.print("\tCharacters: ");
-        for (i = 0; i < newPin.length(); i++) {
+        for (i = 0; i < length; i++) {
           Serial.print(newPin[i], HEX);
           Serial.print(" ");
         }
@@ -862,14 +1581,14 @@ bool HCBT::setPin(String newPin, bool verboseOut) {
         return false;
       }
     }
+    AtCmd<BTPIN, FIRM_VERSION1>::format(command, newPin);
   } else {
     if (verboseOut) {
       Serial.println("\nInvalid entry (not 4-digit integer)");
-      delay(MENU_DELAY);
     }
 #ifdef DEBUG
     Serial.print("\tCharacters: ");
-    for (unsigned int i = 0; i < newPin.length(); i++) {
+    for (unsigned int i = 0; i < length; i++) {
       Serial.print(newPin[i], HEX);
       Serial.print(" ");
     }
@@ -882,46 +1601,42 @@ bool HCBT::setPin(String newPin, bool verboseOut) {
     Serial.print("Setting pin to ");
     Serial.println(newPin);
   }
-  if (firmVersion == FIRM_VERSION1) {
-    command = atCommands[BTPIN] + newPin;
-  } else {
-    command = atCommands[BTPSWD] + setValue[FIRM_VERSION2] + newPin + lineEnding[FIRM_VERSION2];
-  }
-  
-  setCommandMode();
 #ifdef DEBUG
-  Serial.println("\tsending command: " + command);
+  Serial.print("\tsending command: ");
+  Serial.println(command);
 #endif
-  clearInputStream(firmVersion);
-  Serial1.print(command);
-  Serial1.flush();
-  responseDelay(command.length(), firmVersion, BTPIN);
-  if (Serial1.available() > 0) {
-    comBuffer = Serial1.readString();
-    if (verboseOut) {
-      Serial.print(responsePrefix[deviceModel]);
-      Serial.println(comBuffer);
-      Serial.println();
-    }
-  }
-  if (!(comBuffer.startsWith(STATUS_OK))) {
-    if (verboseOut) {
-      Serial.println("Setting pin failed!");
-      delay(MENU_DELAY);
-    }
-    setDataMode();
+  return true;
+}
+
+bool HCBT::beginSetPin(String newPin, bool verboseOut) {
+  if (VERSION_UNKNOWN || busy())
     return false;
+  if (!pinCommand(newPin.c_str(), _cmdBuffer, verboseOut))
+    return false;
+  strncpy(_cfgPin, newPin.c_str(), HC_PIN_MAX);
+  _cfgPin[HC_PIN_MAX] = '\0';
+  // pin written directly replaces staged pin, which shares _cfgPin
+  _staged &= ~HC_SNAP_PIN;
+  if ((cacheValid() & HC_SNAP_PIN) && (strcmp(_cfgPin, btPin) == 0)) {
+    // device already uses pin, no write required
+    startOperation(HC_OP_SET_PIN, STEP_FINISH, verboseOut);
+    return true;
   }
-  setDataMode();
+  startOperation(HC_OP_SET_PIN, STEP_TRANSACTION, verboseOut);
+  startTransaction(_cmdBuffer, firmVersion, BTPIN);
   return true;
 }
 
+bool HCBT::setPin(String newPin, bool verboseOut) {
+  return (beginSetPin(newPin, verboseOut) && waitOperation());
+}
+
 void HCBT::changeParity() {
   String command;
 
   clearSerial();
   Serial.print("Current parity: ");
-  Serial.println(parityType[uartParity]);
+  Serial.println(flashStr(parityType, uartParity));
   Serial.println("Select parity option:");
   Serial.println("\t(0) Cancel");
   Serial.println("\t(1).......No parity");
@@ -935,81 +1650,17 @@ void HCBT::changeParity() {
   if (tempParity < 0) {
     Serial.println("Canceled");
   } else if (tempParity < PARITY_LIST_CNT) {
-    configUART(baudRateList[baudRate], tempParity, true);
+    menuResult(beginConfigUART(baudRateList[baudRate], tempParity, true));
   } else {
     Serial.println("Invalid entry");
   }
 }
 
-bool HCBT::setParity(int parity, bool verboseOut) {
-  String comBuffer = "";
-  String command;
-
-  if (VERSION_UNKNOWN) 
-    return false;
-  command = parityCmd[parity];
-  if (verboseOut) {
-    Serial.println("Setting to " + parityType[parity] + " Parity check");
-  }
-  setCommandMode();
-#ifdef DEBUG
-  Serial.println("\tsending command: " + command);
-#endif
-  clearInputStream(firmVersion);
-  Serial1.print(command);
-  Serial1.flush();
-  responseDelay(command.length(), firmVersion, PARITY_SET);
-
-  if (Serial1.available() > 0) {
-    comBuffer = Serial1.readString();
-    if (verboseOut) {
-      Serial.print(responsePrefix[deviceModel]);
-      Serial.println(comBuffer);
-      Serial.println();
-    }
-#ifdef DEBUG
-    for (unsigned int i = 0; i < comBuffer.length(); i++) {
-      Serial.print("\t");
-      Serial.print(comBuffer.charAt(i), HEX);
-    }
-    Serial.println();
-#endif
-  }
-  if (!(comBuffer.startsWith(STATUS_OK))) {
-    if (verboseOut) {
-      Serial.println("\nRequest failed.");
-      delay(MENU_DELAY);
-    }
-    setDataMode();
-    return false;
-  }
-  // if OK response received, change Serial1 UART settings to match HC-xx
-  Serial1.end();
-  uartParity = parity;
-  delay(CONFIG_DELAY);
-  // firmware version 1.x requires power-cycle of HC-06 to update parity settings
-  if (verboseOut) {
-    Serial.println("To complete change of parity, remove then reconnect power to HC-06.");
-    Serial.println("Enter any character when complete (LED should be blinking).");
-    while (Serial.available() < 1);
-    Serial.readString();   // clear buffer
-  }
-  Serial1.begin(baudRateList[baudRate], parityList[uartParity]);
-  delay(CONFIG_DELAY);
-  if (verboseOut) {
-    Serial.println("Testing new parity configuration . . .");
-    return testEcho(verboseOut);
-  }
-  setDataMode();
-  return true;
-}
-
 int HCBT::indexBaud(unsigned long baud, bool verboseOut) {
   // firmware version 3.x does not support baud rate below 4800
   if ((firmVersion == FIRM_VERSION2) && (baud < baudRateList[VERS2_MIN_BAUD])) {
     if (verboseOut) {
       Serial.println("\nBaud rates below 4800 not supported by this firmware.");
-      delay(MENU_DELAY);
     }
     return -1;
   }
@@ -1020,23 +1671,19 @@ int HCBT::indexBaud(unsigned long baud, bool verboseOut) {
   if (verboseOut) {
     Serial.println("\nBaud rate not supported.");
     Serial.println("See documentation for valid values.");
-    delay(MENU_DELAY);
   }
   return -1;
 }
 
-bool HCBT::configUART(unsigned long baud, int parity, bool verboseOut) {
-  String comBuffer = "";
-  String command;
+bool HCBT::beginConfigUART(unsigned long baud, int parity, bool verboseOut) {
   int baudIndex;
 
-  if (VERSION_UNKNOWN) 
+  if (VERSION_UNKNOWN || busy())
     return false;
   if ((parity < NOPARITY) || (parity > EVENPARITY)){
     if (verboseOut) {
       Serial.println("\nInvalid parity selection.");
       Serial.println("See docmentation for valid values.");
-      delay(MENU_DELAY);
     }
     return false;
   }
@@ -1045,66 +1692,674 @@ bool HCBT::configUART(unsigned long baud, int parity, bool verboseOut) {
   if (baudIndex < 0) {
     return false;
   }
-  // construct AT command for UART configuration based on firmware version
-  if (firmVersion == FIRM_VERSION1) {
-    if (baudIndex != baudRate) {
-      if (!setBaudRate((baudIndex + 1), verboseOut)) 
-        return false;
-    }
-    if (parity != uartParity) {
-      if (!setParity(parity, verboseOut)) 
-        return false;
-    }
+  if ((baudIndex == baudRate) && (parity == uartParity)) {
+    // device already uses UART settings, no write required
+    startOperation(HC_OP_CONFIG_UART, STEP_FINISH, verboseOut);
     return true;
-  } 
-  // FIRM_VERSION2
-  command = constructUARTstring(baud, parity, stopBits);
-  if (verboseOut) {
-    Serial.print("Setting HC0x and local baud rate to ");
-    Serial.println(baud);
-    Serial.println("Setting to " + parityType[parity] + " Parity check");
+  }
+  _cfgBaud = baudIndex;
+  _cfgParity = parity;
+  startOperation(HC_OP_CONFIG_UART, CONFIG_START, verboseOut);
+  return true;
+}
+
+bool HCBT::configUART(unsigned long baud, int parity, bool verboseOut) {
+  return (beginConfigUART(baud, parity, verboseOut) && waitOperation());
+}
+
+void HCBT::stepConfigUART() {
+  char code[2];
+
+  switch (_opStep) {
+    case CONFIG_START:
+      // construct AT command for UART configuration based on firmware version
+      if (firmVersion == FIRM_VERSION2) {
+        AtCmd<BAUD_SET, FIRM_VERSION2>::format(_cmdBuffer, baudRateList[_cfgBaud], 
+                                                stopBits, _cfgParity);
+        if (_opVerbose) {
+          Serial.print("Setting HC0x and local baud rate to ");
+          Serial.println(baudRateList[_cfgBaud]);
+          Serial.print("Setting to ");
+          Serial.print(flashStr(parityType, _cfgParity));
+          Serial.println(" Parity check");
 #ifdef DEBUG
-    Serial.println("\tsending command: " + command);
+          Serial.print("\tsending command: ");
+          Serial.println(_cmdBuffer);
 #endif
-    Serial.println();
+          Serial.println();
+        }
+        startTransaction(_cmdBuffer, firmVersion, BAUD_SET);
+        _opStep = CONFIG_BAUD_WAIT;
+      } else if (_cfgBaud != baudRate) {
+        AtCmd<BAUD_SET, FIRM_VERSION1>::format(_cmdBuffer, (long)(_cfgBaud + 1));
+        if (_opVerbose) {
+          Serial.print("Setting HC06 and local baud rate to ");
+          Serial.println(baudRateList[_cfgBaud]);
+          Serial.print("\tsending command: ");
+          Serial.println(_cmdBuffer);
+          Serial.println();
+        }
+        startTransaction(_cmdBuffer, firmVersion, BAUD_SET);
+        _opStep = CONFIG_BAUD_WAIT;
+      } else if (_cfgParity != uartParity) {
+        if (_opVerbose) {
+          Serial.print("Setting to ");
+          Serial.print(flashStr(parityType, _cfgParity));
+          Serial.println(" Parity check");
+        }
+        code[0] = pgm_read_byte(&parityCode[_cfgParity]);
+        code[1] = '\0';
+        AtCmd<PARITY_SET, FIRM_VERSION1>::format(_cmdBuffer, code);
+#ifdef DEBUG
+        Serial.print("\tsending command: ");
+        Serial.println(_cmdBuffer);
+#endif
+        startTransaction(_cmdBuffer, firmVersion, PARITY_SET);
+        _opStep = CONFIG_PARITY_WAIT;
+      } else {
+        finishOperation(true);
+      }
+      break;
+    case CONFIG_BAUD_WAIT:
+    case CONFIG_PARITY_WAIT:
+      if (!pollTransaction() || retryTransaction())   return;
+      printResponse(true);
+      if (_txStatus[0] != HC_SUCCESS) {
+        if (_opVerbose) {
+          Serial.println("\nRequest failed.");
+        }
+        finishOperation(false, (_opVerbose ? MENU_DELAY : 0));
+        break;
+      }
+      // if OK response received, change Serial1 UART settings to match HC-xx
+      _uart->end();
+      if (_opStep == CONFIG_PARITY_WAIT) {
+        uartParity = _cfgParity;
+        // firmware version 1.x requires power-cycle of HC-06 to update parity settings
+        if (_opVerbose) {
+          Serial.println("To complete change of parity, remove then reconnect power to HC-06.");
+          Serial.println("Enter any character when complete (LED should be blinking).");
+          _opStep = CONFIG_POWER_CYCLE;
+          break;
+        }
+      } else {
+        baudRate = _cfgBaud;
+        if (firmVersion == FIRM_VERSION2) {
+          uartParity = _cfgParity;
+        }
+      }
+      startWait(CONFIG_DELAY);
+      _opStep = CONFIG_BEGIN_UART;
+      break;
+    case CONFIG_POWER_CYCLE:
+      if (Serial.available() < 1)   return;
+      clearSerial();   // clear buffer
+      startWait(0);
+      _opStep = CONFIG_BEGIN_UART;
+      break;
+    case CONFIG_BEGIN_UART:
+      if (!waitDone())  return;
+      _uart->begin(baudRateList[baudRate], parityList[uartParity]);
+      _rxClean = false;
+      startWait(CONFIG_DELAY);
+      _opStep = CONFIG_TEST;
+      break;
+    case CONFIG_TEST:
+      if (!waitDone())  return;
+      if ((firmVersion == FIRM_VERSION1) && (baudRate == _cfgBaud) &&
+            (uartParity == _cfgParity) && !_opVerbose) {
+        // parity change of firmware 1.x is not active until HC-06 is power-cycled
+        finishOperation(true);
+        break;
+      }
+      if (_opVerbose) {
+        Serial.println("Testing new UART configuration . . .");
+      }
+      startEcho();
+      _opStep = CONFIG_TEST_WAIT;
+      break;
+    case CONFIG_TEST_WAIT:
+      if (!pollTransaction())   return;
+      if (!finishEcho()) {
+        finishOperation(false);
+      } else if (uartParity != _cfgParity) {
+        // firmware version 1.x sets parity following baud rate
+        _opStep = CONFIG_START;
+      } else {
+        finishOperation(true);
+      }
+      break;
   }
-  setCommandMode();
-  clearInputStream(firmVersion);
-  Serial1.print(command);
-  Serial1.flush();
-  responseDelay(command.length(), firmVersion, BAUD_SET);
-  if (Serial1.available() > 0) {
-    comBuffer = Serial1.readString();
-    if (verboseOut) {
-      Serial.print(responsePrefix[deviceModel]);
-      Serial.println(comBuffer);
-      Serial.println();
-    }
+}
+
+bool HCBT::queueCommand(const char *command, int cmdIndex) {
+  if ((firmVersion != FIRM_VERSION2) || busy())
+    return false;
+  if (_pipeSent) {
+    // previous pipeline complete, start new pipeline
+    _pipeCommands[0] = '\0';
+    _pipeCount = 0;
+    _pipeSent = false;
+  }
+  if (_pipeCount == 0)  _pipeCommands[0] = '\0';
+  if (_pipeCount >= HC_PIPELINE_MAX)
+    return false;
+  // no commands may follow UART configuration
+  if ((_pipeCount > 0) && (_pipeIndex[_pipeCount - 1] == BAUD_SET))
+    return false;
+  if ((strlen(_pipeCommands) + strlen(command)) >= sizeof(_pipeCommands))
+    return false;
+  strcat(_pipeCommands, command);
+  _pipeIndex[_pipeCount++] = cmdIndex;
+  return true;
+}
+
+bool HCBT::queueName(String newName) {
+  char command[HC_CMD_BUFFER];
+  char name[HC_NAME_MAX + 1];
+
+  if (!nameCommand(newName.c_str(), name, command, false))
+    return false;
+  if (!queueCommand(command, BTNAME))
+    return false;
+  strcpy(_pipeName, name);
+  return true;
+}
+
+bool HCBT::queuePin(String newPin) {
+  char command[HC_CMD_BUFFER];
+
+  if (!pinCommand(newPin.c_str(), command, false))
+    return false;
+  return queueCommand(command, BTPSWD);
+}
+
+bool HCBT::queueRole(int role) {
+  char command[HC_CMD_BUFFER];
+
+  if ((deviceModel != MODEL_HC05) || (role < ROLE_SECONDARY) || 
+        (role > ROLE_SECONDARY_LOOP))
+    return false;
+  AtCmd<ROLE_SET, FIRM_VERSION2>::format(command, (long)role);
+  if (!queueCommand(command, ROLE_SET))
+    return false;
+  _cfgRole = role;
+  return true;
+}
+
+bool HCBT::queueUART(unsigned long baud, int parity) {
+  char command[HC_CMD_BUFFER];
+  int baudIndex;
+
+  if ((parity < NOPARITY) || (parity > EVENPARITY))
+    return false;
+  baudIndex = indexBaud(baud, false);
+  if (baudIndex < 0)
+    return false;
+  AtCmd<BAUD_SET, FIRM_VERSION2>::format(command, baud, stopBits, parity);
+  if (!queueCommand(command, BAUD_SET))
+    return false;
+  _cfgBaud = baudIndex;
+  _cfgParity = parity;
+  return true;
+}
+
+bool HCBT::beginPipeline(bool verboseOut) {
+  if ((firmVersion != FIRM_VERSION2) || busy() || (_pipeCount == 0) || _pipeSent)
+    return false;
+  startOperation(HC_OP_PIPELINE, PIPELINE_WAIT, verboseOut);
+  if (verboseOut) {
+    Serial.print("Sending ");
+    Serial.print(_pipeCount);
+    Serial.println(" pipelined commands");
 #ifdef DEBUG
-    for (unsigned int i = 0; i < comBuffer.length(); i++) {
-      Serial.print("\t");
-      Serial.print(comBuffer.charAt(i), HEX);
-    }
-    Serial.println();
+    Serial.print(_pipeCommands);
 #endif
   }
-  if (!(comBuffer.startsWith(STATUS_OK))) {
-    if (verboseOut) {
-      Serial.println("\nRequest failed.");
-      delay(MENU_DELAY);
+  _pipeSent = true;
+  startTransaction(_pipeCommands, FIRM_VERSION2, OTHER_CMD, _pipeCount);
+  return true;
+}
+
+bool HCBT::sendPipeline(bool verboseOut) {
+  return (beginPipeline(verboseOut) && waitOperation());
+}
+
+int HCBT::pipelineResult(int index) {
+  if ((index < 0) || (index >= _pipeCount) || !_pipeSent)
+    return HC_IDLE;
+  return _pipeStatus[index];
+}
+
+void HCBT::finishPipeline() {
+  bool uartSet = false;
+
+  // responses are matched to commands in order of transmission
+  for (int i = 0; i < _pipeCount; i++) {
+    _pipeStatus[i] = _txStatus[i];
+    _pipeError[i] = _txError[i];
+    if (_op == HC_OP_APPLY_CONFIG) {
+      int result = ((_txStatus[i] == HC_SUCCESS) ? HC_SUCCESS : HC_FAILED);
+      switch (_pipeIndex[i]) {
+        case BTNAME:    _cfgResult.name = result;
+                        break;
+        case BTPSWD:    _cfgResult.pin = result;
+                        break;
+        case ROLE_SET:  _cfgResult.role = result;
+                        break;
+        case BAUD_SET:  // UART result pending until Serial1 is reconfigured and tested
+                        if (result == HC_FAILED)  _cfgResult.uart = HC_FAILED;
+                        break;
+      }
     }
-    setDataMode();
-    return false;
+    if (_txStatus[i] != HC_SUCCESS) {
+      _opSuccess = false;
+      continue;
+    }
+    switch (_pipeIndex[i]) {
+      case BTNAME:
+        strcpy(btName, _pipeName);
+        break;
+      case BTPSWD:
+        // pin of queuePin() is not kept, so cached pin is only known for applyConfig()
+        if (_op == HC_OP_APPLY_CONFIG) {
+          strcpy(btPin, _cfgPin);
+        } else {
+          btPin[0] = '\0';
+        }
+        break;
+      case ROLE_SET:
+        deviceRole = _cfgRole;
+        break;
+      case BAUD_SET:
+        uartSet = true;
+        break;
+    }
+  }
+  if (_opVerbose && !_opSuccess) {
+    Serial.println("\nRequest failed.");
+  }
+  if (!uartSet) {
+    finishOperation(_opSuccess);
+    return;
   }
   // if OK response received, change Serial1 UART settings to match HC-xx
-  Serial1.end();
-  baudRate = baudIndex;
-  uartParity = parity;
-  delay(CONFIG_DELAY);
-  Serial1.begin(baudRateList[baudRate], parityList[uartParity]);
-  delay(CONFIG_DELAY);
+  _uart->end();
+  baudRate = _cfgBaud;
+  uartParity = _cfgParity;
+  startWait(CONFIG_DELAY);
+  _opStep = CONFIG_BEGIN_UART;
+}
+
+bool HCBT::checkConfig(const HCConfig &config, char *name, int &baudIndex, 
+                        int &parity, bool verboseOut) {
+  char command[HC_CMD_BUFFER];
+
+  if ((config.name.length() > 0) && 
+        !nameCommand(config.name.c_str(), name, command, verboseOut))
+    return false;
+  if ((config.pin.length() > 0) && !pinCommand(config.pin.c_str(), command, verboseOut))
+    return false;
+  if ((config.role != ROLE_UNKNOWN) && ((config.role < ROLE_SECONDARY) ||
+        (config.role > ROLE_SECONDARY_LOOP) ||
+        ((deviceModel != MODEL_HC05) && (config.role != ROLE_SECONDARY))))
+    return false;
+  if (config.parity > EVENPARITY)
+    return false;
+  if (config.parity >= 0) {
+    parity = config.parity;
+  }
+  if (config.baud > 0) {
+    baudIndex = indexBaud(config.baud, verboseOut);
+    if (baudIndex < 0)
+      return false;
+  }
+  return true;
+}
+
+bool HCBT::beginApplyConfig(const HCConfig &config, bool verboseOut) {
+  char name[HC_NAME_MAX + 1];
+  int baudIndex = baudRate;
+  int parity = uartParity;
+
+  if (VERSION_UNKNOWN || busy())
+    return false;
+  // validate every setting before any command is sent
+  if (!checkConfig(config, name, baudIndex, parity, verboseOut))
+    return false;
+
+  // only settings which differ from cached configuration are written. Name 
+  //  and pin given replace staged name and pin, which share _cfgName/_cfgPin
+  _cfgResult.name = _cfgResult.pin = _cfgResult.role = _cfgResult.uart = HC_IDLE;
+  if (config.name.length() > 0)   _staged &= ~HC_SNAP_NAME;
+  if (config.pin.length() > 0)    _staged &= ~HC_SNAP_PIN;
+  if ((config.name.length() > 0) && (strcmp(name, btName) != 0)) {
+    strcpy(_cfgName, name);
+    _cfgResult.name = HC_BUSY;
+  }
+  if ((config.pin.length() > 0) && (strcmp(config.pin.c_str(), btPin) != 0)) {
+    strncpy(_cfgPin, config.pin.c_str(), HC_PIN_MAX);
+    _cfgPin[HC_PIN_MAX] = '\0';
+    _cfgResult.pin = HC_BUSY;
+  }
+  if ((deviceModel == MODEL_HC05) && (config.role != ROLE_UNKNOWN) && 
+        (config.role != deviceRole)) {
+    _cfgRole = config.role;
+    _cfgResult.role = HC_BUSY;
+  }
+  if ((baudIndex != baudRate) || (parity != uartParity)) {
+    _cfgBaud = baudIndex;
+    _cfgParity = parity;
+    _cfgResult.uart = HC_BUSY;
+  }
+  _cfgCommit = false;
+  startApply(verboseOut);
+  return true;
+}
+
+void HCBT::startApply(bool verboseOut) {
+  char command[HC_CMD_BUFFER];
+
+  if (firmVersion != FIRM_VERSION2) {
+    startOperation(HC_OP_APPLY_CONFIG, APPLY_NEXT, verboseOut);
+    return;
+  }
+  // firmware 2.x/3.x: send all settings as one pipeline, UART configuration last
+  _pipeCommands[0] = '\0';
+  _pipeCount = 0;
+  _pipeSent = false;
+  if (_cfgResult.name == HC_BUSY) {
+    nameCommand(_cfgName, _pipeName, command, false);
+    queueCommand(command, BTNAME);
+  }
+  if (_cfgResult.pin == HC_BUSY) {
+    pinCommand(_cfgPin, command, false);
+    queueCommand(command, BTPSWD);
+  }
+  if (_cfgResult.role == HC_BUSY) {
+    AtCmd<ROLE_SET, FIRM_VERSION2>::format(command, (long)_cfgRole);
+    queueCommand(command, ROLE_SET);
+  }
+  if (_cfgResult.uart == HC_BUSY) {
+    AtCmd<BAUD_SET, FIRM_VERSION2>::format(command, baudRateList[_cfgBaud], 
+                                            stopBits, _cfgParity);
+    queueCommand(command, BAUD_SET);
+  }
+  if (_pipeCount == 0) {
+    // device already matches requested configuration
+    startOperation(HC_OP_APPLY_CONFIG, STEP_FINISH, verboseOut);
+    return;
+  }
+  _pipeSent = true;
+  startOperation(HC_OP_APPLY_CONFIG, PIPELINE_WAIT, verboseOut);
+  if (verboseOut) {
+    Serial.print("Applying ");
+    Serial.print(_pipeCount);
+    Serial.println(" settings");
+  }
+  startTransaction(_pipeCommands, FIRM_VERSION2, OTHER_CMD, _pipeCount);
+}
+
+bool HCBT::applyConfig(const HCConfig &config, bool verboseOut) {
+  return (beginApplyConfig(config, verboseOut) && waitOperation());
+}
+
+HCConfigResult HCBT::configResult() {
+  return _cfgResult;
+}
+
+bool HCBT::stageConfig(const HCConfig &config) {
+  char name[HC_NAME_MAX + 1];
+  int baudIndex = baudRate;
+  int parity = uartParity;
+
+  // valid settings depend on model and firmware of device
+  if (VERSION_UNKNOWN || !checkConfig(config, name, baudIndex, parity, false))
+    return false;
+  if (config.name.length() > 0) {
+    strcpy(_cfgName, name);
+    _staged |= HC_SNAP_NAME;
+  }
+  if (config.pin.length() > 0) {
+    strncpy(_cfgPin, config.pin.c_str(), HC_PIN_MAX);
+    _cfgPin[HC_PIN_MAX] = '\0';
+    _staged |= HC_SNAP_PIN;
+  }
+  if ((deviceModel == MODEL_HC05) && (config.role != ROLE_UNKNOWN)) {
+    _stageRole = config.role;
+    _staged |= HC_SNAP_ROLE;
+  }
+  if ((config.baud > 0) || (config.parity >= 0)) {
+    _stageBaud = baudIndex;
+    _stageParity = parity;
+    _staged |= HC_SNAP_UART;
+  }
+  return true;
+}
+
+void HCBT::clearStaged() {
+  _staged = 0;
+}
+
+bool HCBT::beginCommit(bool verboseOut) {
+  uint8_t dirty;
+
+  if (VERSION_UNKNOWN || busy())
+    return false;
+  dirty = cacheDirty();
+  _cfgResult.name = _cfgResult.pin = _cfgResult.role = _cfgResult.uart = HC_IDLE;
+  // staged name and pin are held in _cfgName and _cfgPin
+  if (dirty & HC_SNAP_NAME) {
+    _cfgResult.name = HC_BUSY;
+  }
+  if (dirty & HC_SNAP_PIN) {
+    _cfgResult.pin = HC_BUSY;
+  }
+  if (dirty & HC_SNAP_ROLE) {
+    _cfgRole = _stageRole;
+    _cfgResult.role = HC_BUSY;
+  }
+  if (dirty & HC_SNAP_UART) {
+    _cfgBaud = _stageBaud;
+    _cfgParity = _stageParity;
+    _cfgResult.uart = HC_BUSY;
+  }
+  // staged settings already matching device need not be written again
+  _staged &= dirty;
+  _cfgCommit = true;
+  startApply(verboseOut);
+  return true;
+}
+
+bool HCBT::commit(bool verboseOut) {
+  return (beginCommit(verboseOut) && waitOperation());
+}
+
+uint8_t HCBT::cacheValid() {
+  uint8_t valid = 0;
+
+  if (btName[0] != '\0')            valid |= HC_SNAP_NAME;
+  if (btPin[0] != '\0')             valid |= HC_SNAP_PIN;
+  if (deviceRole != ROLE_UNKNOWN)   valid |= HC_SNAP_ROLE;
+  if (VERSION_KNOWN)                valid |= HC_SNAP_UART;
+  return valid;
+}
+
+uint8_t HCBT::cacheDirty() {
+  uint8_t dirty = 0;
+
+  // unknown name and pin are empty, so never match staged value
+  if ((_staged & HC_SNAP_NAME) && (strcmp(_cfgName, btName) != 0))
+    dirty |= HC_SNAP_NAME;
+  if ((_staged & HC_SNAP_PIN) && (strcmp(_cfgPin, btPin) != 0))
+    dirty |= HC_SNAP_PIN;
+  if ((_staged & HC_SNAP_ROLE) && (_stageRole != deviceRole))
+    dirty |= HC_SNAP_ROLE;
+  if ((_staged & HC_SNAP_UART) && (VERSION_UNKNOWN || (_stageBaud != baudRate) || 
+        (_stageParity != uartParity)))
+    dirty |= HC_SNAP_UART;
+  return dirty;
+}
+
+void HCBT::stepApplyConfig() {
+  int result;
+
+  switch (_opStep) {
+    case APPLY_NEXT:
+      if (_cfgResult.name == HC_BUSY) {
+        nameCommand(_cfgName, _cfgName, _cmdBuffer, false);
+        if (_opVerbose) {
+          Serial.print("Setting name to ");
+          Serial.println(_cfgName);
+        }
+        startTransaction(_cmdBuffer, firmVersion, BTNAME);
+        _opStep = APPLY_NAME_WAIT;
+      } else if (_cfgResult.pin == HC_BUSY) {
+        pinCommand(_cfgPin, _cmdBuffer, _opVerbose);
+        startTransaction(_cmdBuffer, firmVersion, BTPIN);
+        _opStep = APPLY_PIN_WAIT;
+      } else if (_cfgResult.uart == HC_BUSY) {
+        // HC-06 remains in command mode, so UART is configured in same session
+        _opStep = CONFIG_START;
+      } else {
+        finishOperation(true);
+      }
+      break;
+    case APPLY_NAME_WAIT:
+    case APPLY_PIN_WAIT:
+      if (!pollTransaction())   return;
+      printResponse(true);
+      result = ((_txStatus[0] == HC_SUCCESS) ? HC_SUCCESS : HC_FAILED);
+      if (result == HC_FAILED) {
+        _opSuccess = false;
+      }
+      if (_opStep == APPLY_NAME_WAIT) {
+        _cfgResult.name = result;
+        if (result == HC_SUCCESS) {
+          strcpy(btName, _cfgName);
+        }
+      } else {
+        _cfgResult.pin = result;
+        if (result == HC_SUCCESS) {
+          strcpy(btPin, _cfgPin);
+        }
+      }
+      _opStep = APPLY_NEXT;
+      break;
+  }
+}
+
+bool HCBT::beginReadAll(bool verboseOut) {
+  if ((firmVersion != FIRM_VERSION2) || busy())
+    return false;
+  memset(&_snapshot, 0, sizeof(_snapshot));
+  _snapshot.role = ROLE_UNKNOWN;
+  _snapNext = 0;
+  // queries are sent from pipeline buffer, replacing any queued commands
+  _pipeCommands[0] = '\0';
+  _pipeCount = 0;
+  _pipeSent = false;
+  startOperation(HC_OP_READ_ALL, SNAPSHOT_NEXT, verboseOut);
   if (verboseOut) {
-    Serial.println("Testing new UART configuration . . .");
+    Serial.println("Reading device properties");
+  }
+  return true;
+}
+
+bool HCBT::readAll(bool verboseOut) {
+  return (beginReadAll(verboseOut) && waitOperation());
+}
+
+const HCSnapshot &HCBT::snapshot() {
+  return _snapshot;
+}
+
+void HCBT::stepReadAll() {
+  int count = 0;
+
+  switch (_opStep) {
+    case SNAPSHOT_NEXT:
+      if (_snapNext >= (int)PROPERTY_CNT) {
+        if (_snapshot.valid & HC_SNAP_NAME)  strcpy(btName, _snapshot.name);
+        if (_snapshot.valid & HC_SNAP_PIN)   strcpy(btPin, _snapshot.pin);
+        if (_snapshot.valid & HC_SNAP_ROLE)  deviceRole = _snapshot.role;
+        finishOperation(_opSuccess);
+        break;
+      }
+      // each burst is limited by status capacity of transaction
+      _pipeCommands[0] = '\0';
+      while ((_snapNext < (int)PROPERTY_CNT) && (count < HC_PIPELINE_MAX)) {
+        strcat_P(_pipeCommands, propertyQueries[_snapNext++]);
+        strcat(_pipeCommands, ENDLINE_NLCR);
+        count++;
+      }
+      startTransaction(_pipeCommands, FIRM_VERSION2, OTHER_CMD, count);
+      _opStep = SNAPSHOT_WAIT;
+      break;
+    case SNAPSHOT_WAIT:
+      if (!pollTransaction())   return;
+      printResponse(true);
+      if (!_txComplete) {
+        // device stopped responding, remaining queries are not sent
+        if (_opVerbose) {
+          Serial.println("\nRequest failed.");
+        }
+        finishOperation(false);
+        break;
+      }
+      _opStep = SNAPSHOT_NEXT;
+      break;
+  }
+}
+
+void HCBT::storeProperty(const char *line, const char *value) {
+  const char *key = line + 1;
+  char *end;
+  uint8_t field = 0;
+
+  // bit of field is position of key in propertyKeys
+  for (unsigned int i = 0; i < PROPERTY_CNT; i++) {
+    if (strncmp_P(key, propertyKeys[i], strlen_P(propertyKeys[i])) == 0)
+      field = (1 << i);
+  }
+  if (strncmp(key, PIN_KEY, sizeof(PIN_KEY) - 1) == 0)
+    field = HC_SNAP_PIN;
+  switch (field) {
+    case HC_SNAP_NAME:
+      if (!copyValue(_snapshot.name, value, HC_NAME_MAX))   return;
+      break;
+    case HC_SNAP_PIN:
+      if (!copyValue(_snapshot.pin, value, HC_PIN_MAX))   return;
+      break;
+    case HC_SNAP_UART:
+      // baud,stop,parity
+      _snapshot.baud = strtoul(value, &end, 10);
+      if (*end != ',')  return;
+      _snapshot.stopBits = (uint8_t)strtoul(end + 1, &end, 10);
+      if (*end != ',')  return;
+      _snapshot.parity = (uint8_t)strtoul(end + 1, &end, 10);
+      break;
+    case HC_SNAP_ADDR:
+      if (!copyValue(_snapshot.address, value, HC_ADDR_MAX))   return;
+      break;
+    case HC_SNAP_CLASS:
+      // hexadecimal
+      _snapshot.deviceClass = strtoul(value, &end, 16);
+      if (end == value)   return;
+      break;
+    case HC_SNAP_CMODE:
+      _snapshot.connectMode = (uint8_t)strtoul(value, &end, 10);
+      if (end == value)   return;
+      break;
+    case HC_SNAP_BIND:
+      if (!copyValue(_snapshot.bindAddress, value, HC_ADDR_MAX))   return;
+      break;
+    case HC_SNAP_ROLE:
+      _snapshot.role = (int8_t)strtol(value, &end, 10);
+      if (end == value)   return;
+      break;
+    default:
+      return;
   }
-  return testEcho(verboseOut);
+  _snapshot.valid |= field;
 }
@@ -18,6 +18,26 @@
 
 #include <Arduino.h>
 
+// UART type is selected at compile time, so termios headers and code of host 
+//  builds (and the simulator) are never compiled into board builds. HCBT still
+//  calls the UART through Stream, whose methods are virtual.
+#if defined(HC_SIMULATOR) && defined(HC_TERMIOS)
+  #error "HC_SIMULATOR and HC_TERMIOS select different UART types"
+#endif
+
+#ifdef HC_SIMULATOR
+class HCSimulator;
+/** UART type connected to HC-0x (simulated module of simulateBT.h) */
+typedef HCSimulator HCSerial;
+#elif defined(HC_TERMIOS)
+class HCTermios;
+/** UART type connected to HC-0x (serial port of Linux host, see termiosBT.h) */
+typedef HCTermios HCSerial;
+#else
+/** UART type connected to HC-0x (must support begin() and end()) */
+typedef HardwareSerial HCSerial;
+#endif
+
 /** index for unknown device role */
 #define ROLE_UNKNOWN         -1
 /** index for HC-05 devices in secondary role */
@@ -27,6 +47,286 @@
 /** index for HC-05 devices in secondary-loop role */
 #define ROLE_SECONDARY_LOOP   2
 
+/** no asynchronous operation has been started */
+#define HC_IDLE               0
+/** asynchronous operation in progress, continue calling poll() */
+#define HC_BUSY               1
+/** asynchronous operation completed successfully */
+#define HC_SUCCESS            2
+/** asynchronous operation failed */
+#define HC_FAILED             3
+
+/** identifier for no operation */
+#define HC_OP_NONE            0
+/** identifier for detectDevice() operation */
+#define HC_OP_DETECT          1
+/** identifier for configUART() operation */
+#define HC_OP_CONFIG_UART     2
+/** identifier for setName() operation */
+#define HC_OP_SET_NAME        3
+/** identifier for setPin() operation */
+#define HC_OP_SET_PIN         4
+/** identifier for setRole() operation */
+#define HC_OP_SET_ROLE        5
+/** identifier for getRole() operation */
+#define HC_OP_GET_ROLE        6
+/** identifier for getVersionString() operation */
+#define HC_OP_GET_VERSION     7
+/** identifier for sendPipeline() operation */
+#define HC_OP_PIPELINE        8
+/** identifier for applyConfig() operation */
+#define HC_OP_APPLY_CONFIG    9
+/** identifier for readAll() operation */
+#define HC_OP_READ_ALL        10
+/** identifier for detection followed by commit of staged configuration (HCManager) */
+#define HC_OP_PROVISION       11
+/** identifier for provisioning job list (HCManager) */
+#define HC_OP_RUN_JOBS        12
+
+/** maximum count of commands sent in single pipelined transaction */
+#define HC_PIPELINE_MAX       4
+
+/** maximum length of Bluetooth name */
+#define HC_NAME_MAX           20
+/** maximum length of Bluetooth passkey (firmware 2.x/3.x) */
+#define HC_PIN_MAX            14
+/** capacity of buffer for single AT command, including line ending */
+#define HC_CMD_BUFFER         32
+/** capacity of buffer for AT response (worst-case response is 40 characters) */
+#define HC_RESPONSE_BUFFER    48
+/** capacity of buffer for firmware version string */
+#define HC_VERSION_BUFFER     32
+/** maximum length of Bluetooth address (NAP:UAP:LAP, e.g. 98d3:31:fb1234) */
+#define HC_ADDR_MAX           14
+
+/** HCSnapshot field read: Bluetooth name */
+#define HC_SNAP_NAME          0x01
+/** HCSnapshot field read: Bluetooth pin/passkey */
+#define HC_SNAP_PIN           0x02
+/** HCSnapshot field read: UART configuration */
+#define HC_SNAP_UART          0x04
+/** HCSnapshot field read: Bluetooth address */
+#define HC_SNAP_ADDR          0x08
+/** HCSnapshot field read: device class */
+#define HC_SNAP_CLASS         0x10
+/** HCSnapshot field read: connection mode */
+#define HC_SNAP_CMODE         0x20
+/** HCSnapshot field read: bound Bluetooth address */
+#define HC_SNAP_BIND          0x40
+/** HCSnapshot field read: role */
+#define HC_SNAP_ROLE          0x80
+
+// uncomment following line (or define HC_TX_STATS for build) to record 
+//  latency of AT transactions, see HCBT::txStats()
+//#define HC_TX_STATS     1
+
+/** count of AT command indexes (as defined in HCxxCommands) */
+#define HC_CMD_CNT            11
+
+/** transaction outcome: OK status received */
+#define HC_TX_OK              0
+/** transaction outcome: ERROR status (or unexpected fw 1.x reply) received */
+#define HC_TX_ERROR           1
+/** transaction outcome: no complete response before timeout */
+#define HC_TX_TIMEOUT         2
+
+/**
+ * HCError enum
+ * 
+ * Reason for failure of AT command. Codes from HC_ERR_COMMAND to 
+ * HC_ERR_ENCRYPT_MODE equal the code x of firmware 2.x/3.x ERROR:(x) status
+ * (see errorString() for description).
+ */
+enum HCError {HC_ERR_NONE = -1,           // OK status received
+              HC_ERR_COMMAND = 0x00,      // command error/invalid command
+              HC_ERR_DEFAULT,             // results in default value
+              HC_ERR_PSKEY_WRITE,         // PSKEY write error
+              HC_ERR_NAME_LONG,           // device name too long
+              HC_ERR_NAME_EMPTY,          // no device name specified
+              HC_ERR_NAP_LONG,            // Bluetooth address NAP too long
+              HC_ERR_UAP_LONG,            // Bluetooth address UAP too long
+              HC_ERR_LAP_LONG,            // Bluetooth address LAP too long
+              HC_ERR_PIO_EMPTY,           // PIO map not specified
+              HC_ERR_PIO_PORT,            // invalid PIO port number
+              HC_ERR_CLASS_EMPTY,         // device class not specified
+              HC_ERR_CLASS_LONG,          // device class too long
+              HC_ERR_IAC_EMPTY,           // inquire access code not specified
+              HC_ERR_IAC_LONG,            // inquire access code too long
+              HC_ERR_IAC_INVALID,         // invalid inquire access code
+              HC_ERR_PSWD_EMPTY,          // pairing password not specified
+              HC_ERR_PSWD_LONG,           // pairing password too long
+              HC_ERR_ROLE,                // invalid role
+              HC_ERR_BAUD,                // invalid baud rate
+              HC_ERR_STOP_BIT,            // invalid stop bit
+              HC_ERR_PARITY,              // invalid parity bit
+              HC_ERR_NO_PAIRED,           // no device in pairing list
+              HC_ERR_SPP_NOT_INIT,        // SPP not initialized
+              HC_ERR_SPP_INIT,            // SPP already initialized
+              HC_ERR_INQUIRY_MODE,        // invalid inquiry mode
+              HC_ERR_INQUIRY_TIMEOUT,     // inquiry timeout
+              HC_ERR_ADDRESS,             // invalid/zero length address
+              HC_ERR_SECURITY_MODE,       // invalid security mode
+              HC_ERR_ENCRYPT_MODE,        // invalid encryption mode
+              HC_ERR_UNKNOWN,             // unrecognized ERROR code, or fw 1.x reply not OK
+              HC_ERR_TIMEOUT};            // no status received before timeout
+
+/**
+ * HCReply struct
+ * 
+ * Reply of HC-xx device to single AT command.
+ */
+struct HCReply {
+  /** HC_SUCCESS, HC_FAILED, or HC_IDLE if no status received */
+  int status;
+  /** reason for failure (HC_ERR_NONE if successful) */
+  HCError error;
+};
+
+#ifdef HC_TX_STATS
+/**
+ * HCTxStats struct
+ * 
+ * Latency of AT transactions for one command index (as defined in 
+ * HCxxCommands). Timestamps (ms, clock of HCBT) are of last transaction.
+ */
+struct HCTxStats {
+  /** transaction started (EN/KEY pin switched to command mode if needed) */
+  unsigned long modeAt;
+  /** HC-xx parser flushed (CRLF if needed) and input discarded */
+  unsigned long flushAt;
+  /** command written, and transmitted by Serial1 */
+  unsigned long writeAt;
+  /** first character of response received (0 if none) */
+  unsigned long firstByteAt;
+  /** response complete, or timed out */
+  unsigned long completeAt;
+  /** outcome of last transaction (HC_TX_xxx) */
+  int lastOutcome;
+  /** count of transactions by outcome, indexed by HC_TX_xxx */
+  unsigned long outcomes[3];
+  /** longest and total time from write to complete response (ms) */
+  unsigned long maxResponse;
+  unsigned long totalResponse;
+};
+#endif
+
+class HCBT;
+
+/**
+ * Callback for completion of asynchronous operation.
+ * 
+ * @param device      HCBT instance which completed operation
+ * @param operation   identifier of completed operation (HC_OP_xxx)
+ * @param success     true if operation succeeded
+ */
+typedef void (*HCCallback)(HCBT *device, int operation, bool success);
+
+/**
+ * HCClock class
+ * 
+ * Time source of HCBT for all waits and timeouts. Default implementation uses
+ * Arduino millis(), delay() and yield(). Host builds may substitute a virtual
+ * clock (see HCVirtualClock), so modeled device time is not spent in real time.
+ */
+class HCClock
+{
+public:
+  virtual ~HCClock() {}
+  /** @returns current time (ms) */
+  virtual unsigned long millis() { return ::millis(); }
+  /** @brief Wait for period (ms). */
+  virtual void delay(unsigned long ms) { ::delay(ms); }
+  /** @brief Called repeatedly while a blocking method waits for operation. */
+  virtual void idle() { yield(); }
+};
+
+/**
+ * HCVirtualClock class
+ * 
+ * Clock advanced only by delay() and idle() (1 ms per call), or advance(). 
+ */
+class HCVirtualClock : public HCClock
+{
+public:
+  HCVirtualClock(unsigned long start = 0) : _now(start) {}
+  unsigned long millis() { return _now; }
+  void delay(unsigned long ms) { _now += ms; }
+  void idle() { _now++; }
+  /** @brief Advance clock by period (ms). */
+  void advance(unsigned long ms) { _now += ms; }
+
+private:
+  unsigned long _now;
+};
+
+/** default time source of HCBT (Arduino millis()/delay()) */
+extern HCClock HCArduinoClock;
+
+/**
+ * HCConfig struct
+ * 
+ * Desired configuration of HC-xx device, applied by applyConfig(). Settings
+ * left at default values are not modified.
+ */
+struct HCConfig {
+  /** Bluetooth name (empty - not modified) */
+  String name;
+  /** Bluetooth pin/passkey (empty - not modified) */
+  String pin;
+  /** role of HC-05 device (ROLE_UNKNOWN - not modified) */
+  int role;
+  /** UART baud rate, e.g. 9600 (0 - not modified) */
+  unsigned long baud;
+  /** UART parity: 0 - NOPARITY, 1 - ODDPARITY, 2 - EVENPARITY (-1 - not modified) */
+  int parity;
+
+  HCConfig() : role(ROLE_UNKNOWN), baud(0), parity(-1) {}
+};
+
+/**
+ * HCConfigResult struct
+ * 
+ * Result of each setting of last applyConfig(): HC_IDLE if setting was not
+ * written (not requested or already matches device), HC_SUCCESS or HC_FAILED.
+ */
+struct HCConfigResult {
+  int name;
+  int pin;
+  int role;
+  int uart;
+};
+
+/**
+ * HCSnapshot struct
+ * 
+ * Properties of firmware 2.x/3.x device, read by readAll(). Fields which were
+ * not read (command not supported by device) are not flagged in valid.
+ */
+struct HCSnapshot {
+  /** fields read from device (HC_SNAP_xxx flags) */
+  uint8_t valid;
+  /** Bluetooth name */
+  char name[HC_NAME_MAX + 1];
+  /** Bluetooth pin/passkey */
+  char pin[HC_PIN_MAX + 1];
+  /** UART baud rate, e.g. 9600 */
+  unsigned long baud;
+  /** UART stop bits: 0 - 1 bit, 1 - 2 bits */
+  uint8_t stopBits;
+  /** UART parity: 0 - NOPARITY, 1 - ODDPARITY, 2 - EVENPARITY */
+  uint8_t parity;
+  /** Bluetooth address (NAP:UAP:LAP, hexadecimal) */
+  char address[HC_ADDR_MAX + 1];
+  /** device class (Class of Device) */
+  unsigned long deviceClass;
+  /** role (ROLE_xxx) */
+  int8_t role;
+  /** connection mode: 0 - bound address only, 1 - any address, 2 - loop */
+  uint8_t connectMode;
+  /** bound Bluetooth address (NAP:UAP:LAP, hexadecimal) */
+  char bindAddress[HC_ADDR_MAX + 1];
+};
+
 
 /**
  * HCBT class
@@ -45,167 +345,552 @@ private:
   void initDevice();
 
   /**
-   * fetchRole
+   * selectBaudRate
+   *  
+   * Configure baud rate of HC-xx UART.
+   * Prints menu to Serial to select desired baud rate for UART.
+   */
+  void selectBaudRate();
+
+  /**
+   * changeName
+   *  
+   * Configure name of Bluetooth module.
+   * Provides prompts to Serial to enter new BT name. Prepends 'HC05_' or 'HC06_' 
+   * to user input string. 
+   */
+  void changeName();
+
+  /**
+   * changePin
+   *  
+   * Configure Bluetooth pin of HC-xx device.
+   * Provides prompts to Serial to enter new BT pin/passkey of HC-xx device.
+   */
+  void changePin();
+
+  /**
+   * changeParity
    *  
-   * Send AT command to request current BT role for HC-05 device.
+   * Configure parity of HC-xx UART.
+   * Prints menu to Serial to select desired parity for UART.
+   */
+  void changeParity();
+
+  /**
+   * menuResult
    * 
-   * @param verboseOut     if true, prints verbose output to Serial
+   * @brief Complete operation started by menu selection, or wait MENU_DELAY 
+   *        so that message of rejected entry can be read.
    * 
-   * @returns  current role setting of device:
-   *    - ROLE_UNKNOWN    - unknown (may be HC-06 fw version 1.x)
-   *    - ROLE_SECONDARY  - acts as discoverable wireless UART device ready for transparent data exchange
-   *    - ROLE_PRIMARY    - scans for a remote bluetooth (secondary) device, pairs, and setup connection
-   *    - ROLE_SECONDARY_LOOP - data loop-back Rx-Tx, used mainly for testing
+   * @param started   result of begin*() call for selection
+   */
+  void menuResult(bool started);
+
+  /**
+   * clearSerial
+   * 
+   * @brief Clears Serial input buffer before requesting new response.
    */
-  int fetchRole(bool verboseOut = false);
+  void clearSerial();
 
   /**
-   * fetchVersion
+   * clearInputStream
+   * 
+   * @brief Discards any characters waiting in Serial1 input buffer.
+   */
+  void clearInputStream();
+
+  /**
+   * switchMode
    *  
-   * Send AT command to request firmware version to Serial1 and return response.
+   * @brief Drive EN/KEY pin for requested mode of HC-05 without waiting.
    * 
-   * @param verboseOut     if true, prints verbose output to Serial
+   * @param mode    MODE_COMMAND or MODE_DATA
    * 
-   * @returns version string returned by HC-0x device
+   * @returns true if EN/KEY pin was switched and must be allowed to settle
    */
-  String fetchVersion(bool verboseOut = false);
+  bool switchMode(int mode);
 
   /**
-   * selectBaudRate
+   * startWait
+   * 
+   * @brief Start non-blocking wait period, checked with waitDone().
+   * 
+   * @param period    length of wait in milliseconds
+   */
+  void startWait(unsigned long period);
+
+  /**
+   * waitDone
+   * 
+   * @returns true if period given to startWait() has elapsed
+   */
+  bool waitDone();
+
+  /**
+   * responseTime
    *  
-   * Configure baud rate of HC-xx UART.
-   * Prints menu to Serial to select desired baud rate for UART.
+   * @brief Returns worst-case period (ms) for completion of HC-xx response to command.
+   * 
+   * @param characters  count of characters in AT command
+   * @param firmware    firmware version identifier for HC-xx
+   * @param command     index of AT command (as defined in HCxxCommands)
+   * 
+   * @returns response period in milliseconds
    */
-  void selectBaudRate();
+  unsigned long responseTime(unsigned long characters, int firmware, int command);
 
   /**
-   * setBaudRate
+   * idleGap
    *  
-   * Configure baud rate of HC-xx UART with firmware 1.x.
-   * Sends AT command to configure baud rate of HC-xx UART and displays response.
-   * If successful, updates Serial1 configuration to new UART settings.
+   * @brief Returns idle period (ms) of UART which marks end of firmware 1.x response.
    * 
-   * @param newBaud       desired buad rate to configure HC-xx device UART
-   *    - 1   - 1200
-   *    - 2   - 2400
-   *    - 3   - 4800
-   *    - 4   - 9600
-   *    - 5   - 19200
-   *    - 6   - 38400
-   *    - 7   - 57600
-   *    - 8   - 115200
-   * @param verboseOut    if true, prints verbose output to Serial
+   * Computed as IDLE_GAP_CHARS character periods at current baud rate, plus
+   * transportLatency().
    * 
-   * @returns true if setting baud rate succeeds 
+   * @returns idle period in milliseconds
    */
-  bool setBaudRate(int newBaud, bool verboseOut = false);
+  unsigned long idleGap();
 
   /**
-   * changeName
+   * transportLatency
    *  
-   * Configure name of Bluetooth module.
-   * Provides prompts to Serial to enter new BT name. Prepends 'HC05_' or 'HC06_' 
-   * to user input string. 
+   * @brief Returns allowance (ms) for delivery latency of UART driver, added
+   *        to response and idle periods (HCTermios::latency() for host 
+   *        builds, 0 for board UARTs).
    */
-  void changeName();
+  unsigned long transportLatency();
 
   /**
-   * changeRole
+   * startTransaction
    *  
-   * Send AT command to set BT role of HC-05 device.
+   * @brief Begin non-blocking AT transaction, advanced by pollTransaction().
    * 
-   * @param role     role to set HC-05 device:
+   * Places HC-05 in command mode, clears input stream, sends command and
+   * collects response into _txResponse. For firmware 2.x/3.x, a CRLF is sent
+   * first to terminate any partial command, unless previous response ended 
+   * cleanly with a complete status line. For firmware 2.x/3.x, several
+   * commands may be sent back-to-back, each answered by its own status line.
+   * 
+   * @param command     AT command string (including line ending), which must
+   *                    remain valid until transaction is complete
+   * @param firmware    firmware version identifier for HC-xx
+   * @param cmdIndex    index of AT command (as defined in HCxxCommands)
+   * @param replies     count of commands in command string (firmware 2.x/3.x)
+   */
+  void startTransaction(const char *command, int firmware, int cmdIndex, 
+                        int replies = 1);
+
+  /**
+   * appendResponse
+   * 
+   * @brief Store received character in _txResponse.
+   * 
+   * If buffer is full, completed lines are discarded so that status line of
+   * each pipelined command is still captured. Characters of a single line
+   * exceeding buffer capacity are dropped.
+   * 
+   * @param inChar      character received from HC-xx
+   */
+  void appendResponse(char inChar);
+
+  /**
+   * pollTransaction
+   * 
+   * @brief Advance AT transaction started by startTransaction().
+   * 
+   * For firmware 2.x/3.x, response is complete as soon as a status line
+   * (OK or ERROR) terminated by CRLF is received for each command, or if no 
+   * character is received within the worst-case response period. For firmware 1.x,
+   * responses are not terminated, so response is complete once UART is idle
+   * for idleGap().
+   * 
+   * @returns true once transaction is complete
+   */
+  bool pollTransaction();
+
+  /**
+   * responseOK
+   * 
+   * @returns true if response of last transaction begins with OK
+   */
+  bool responseOK();
+
+  /**
+   * parseLine
+   * 
+   * @brief Classify complete line of firmware 2.x/3.x response, in place.
+   * 
+   * @param line        line received (terminated by LF)
+   * @param value       set to text following ':' of +KEY:value line, or 
+   *                    following '(' of ERROR:(x) status
+   * 
+   * @returns type of line (as defined in HCxxLineTypes)
+   */
+  int parseLine(const char *line, const char **value);
+
+  /**
+   * finishReplies
+   * 
+   * @brief Complete result of each command of finished transaction. Firmware
+   *        1.x replies are typed by their OK prefix, and commands without
+   *        status are marked HC_ERR_TIMEOUT.
+   */
+  void finishReplies();
+
+  /**
+   * retryTransaction
+   * 
+   * @brief Resend single command of finished firmware 2.x/3.x transaction, 
+   *        once, if it failed with error which may be transient (command 
+   *        corrupted on UART, or PSKEY write error).
+   * 
+   * @returns true if command was resent
+   */
+  bool retryTransaction();
+
+#ifdef HC_TX_STATS
+  /**
+   * recordStats
+   * 
+   * @brief Record outcome and completion time of finished transaction.
+   */
+  void recordStats();
+#endif
+
+  /**
+   * responseGarbled
+   * 
+   * @brief Test for reply received with UART parity mismatched to HC-0x. 
+   * 
+   * Characters of reply are framed correctly at the right baud rate, but may 
+   * be flagged with parity errors and dropped, so OK/ERROR status is only 
+   * partially received. Characters received must keep their order within
+   * OK/ERROR status, any other character is taken as noise.
+   * 
+   * @returns true if response of last transaction is neither OK nor a
+   *          well-formed ERROR status, but consists of characters of OK/ERROR
+   *          status in order
+   */
+  bool responseGarbled();
+
+  /**
+   * responseError
+   * 
+   * @brief Test for well-formed ERROR:(x) status, which is only received 
+   *        when baud rate matches HC-0x (fw 2.x/3.x). Parity matches too, 
+   *        unless Serial1 has no parity check (replies with parity accepted).
+   * 
+   * @returns true if response of last transaction starts with ERROR status
+   */
+  bool responseError();
+
+  /**
+   * printResponse
+   * 
+   * @brief Print response of last transaction to Serial if verbose output enabled.
+   * 
+   * @param blankLine   if true, prints empty line following response
+   */
+  void printResponse(bool blankLine = false);
+
+  /**
+   * startOperation
+   * 
+   * @brief Prepare state for new asynchronous operation.
+   * 
+   * @param operation   identifier of operation (HC_OP_xxx)
+   * @param step        first step of operation (as defined in HCxxSteps)
+   * @param verboseOut  if true, prints verbose output to Serial
+   */
+  void startOperation(int operation, int step, bool verboseOut);
+
+  /**
+   * finishOperation
+   * 
+   * @brief Return HC-05 to data mode (unless a session is open) and complete 
+   *        current operation once EN/KEY pin has settled.
+   * 
+   * @param success     result of operation
+   * @param holdMS      minimum period before completion is reported (used to
+   *                    pause verbose output after failure)
+   */
+  void finishOperation(bool success, unsigned long holdMS = 0);
+
+  /**
+   * stepOperation
+   * 
+   * @brief Advance current asynchronous operation by one step, if ready.
+   */
+  void stepOperation();
+
+  /**
+   * stepDetect
+   * 
+   * @brief Advance steps of detectDevice() operation.
+   */
+  void stepDetect();
+
+  /**
+   * stepConfigUART
+   * 
+   * @brief Advance steps of configUART() operation.
+   */
+  void stepConfigUART();
+
+  /**
+   * nextProbe
+   * 
+   * @brief Advance detection scan to next firmware, parity and baud combination.
+   * 
+   * Hinted configuration (last detected) and its neighbors are tested first, 
+   * followed by full scan (see scanPasses), firmware 2.x/3.x before firmware
+   * 1.x. Baud rates estimated from a mis-framed reply are tested 
+   * ahead of the scan. Once a garbled reply identifies 
+   * baud rate, other parity settings at that baud rate are tested next. 
+   * Combinations already tested are skipped.
+   * 
+   * @returns false if all combinations have been tested
+   */
+  bool nextProbe();
+
+  /**
+   * claimProbe
+   * 
+   * @brief Select combination as next probe of detection scan, unless tested.
+   * 
+   * @returns false if combination has already been tested
+   */
+  bool claimProbe(int firmware, int baud, int parity);
+
+  /**
+   * estimateBaud
+   * 
+   * @brief Rank baud rates of HC-0x by comparing characters of response to 
+   *        probe with those expected for a mis-framed OK/ERROR status at each
+   *        baud rate (see misframedStatus). Ranked baud rates are tested next
+   *        by detection scan, at current parity.
+   */
+  void estimateBaud();
+
+  /**
+   * saveHint
+   * 
+   * @brief Record current UART configuration as hint for next detection, and
+   *        store in EEPROM if enabled by useEEPROMHint().
+   */
+  void saveHint();
+
+  /**
+   * startEcho
+   * 
+   * @brief Start AT transaction to test configuration of UART.
+   */
+  void startEcho();
+
+  /**
+   * finishEcho
+   * 
+   * @brief Check response to AT echo transaction. If OK response not
+   *        received, device identification is reset.
+   *  
+   * @returns true if responds with OK
+   */
+  bool finishEcho();
+
+  /**
+   * startFetchRole
+   * 
+   * @brief Start AT transaction to request current BT role for HC-05 device.
+   */
+  void startFetchRole();
+
+  /**
+   * finishFetchRole
+   * 
+   * @brief Parse response to BT role request and update cached role.
+   * 
+   * @returns  current role setting of device:
+   *    - ROLE_UNKNOWN    - unknown (may be HC-06 fw version 1.x)
    *    - ROLE_SECONDARY  - acts as discoverable wireless UART device ready for transparent data exchange
    *    - ROLE_PRIMARY    - scans for a remote bluetooth (secondary) device, pairs, and setup connection
    *    - ROLE_SECONDARY_LOOP - data loop-back Rx-Tx, used mainly for testing
-   * @param verboseOut     if true, prints verbose output to Serial
+   */
+  int finishFetchRole();
+
+  /**
+   * startChangeRole
+   * 
+   * @brief Start AT transaction to set BT role of HC-05 device.
+   * 
+   * @param role     role to set HC-05 device (ROLE_xxx)
+   */
+  void startChangeRole(int role);
+
+  /**
+   * finishChangeRole
+   * 
+   * @brief Check response to set BT role request and update cached role.
+   * 
+   * @param role     role requested of HC-05 device (ROLE_xxx)
    * 
    * @returns true if request succeeds.
    */
-  bool changeRole(int role, bool verboseOut);
+  bool finishChangeRole(int role);
 
   /**
-   * changePin
-   *  
-   * Configure Bluetooth pin of HC-xx device.
-   * Provides prompts to Serial to enter new BT pin/passkey of HC-xx device.
+   * startFetchModel
+   * 
+   * @brief Start AT transaction to request BT address, which is answered by
+   *        HC-05 but not by HC-06 with firmware 2.x/3.x. Read-only, unlike
+   *        testing whether role can be set.
+   */
+  void startFetchModel();
+
+  /**
+   * finishFetchModel
+   * 
+   * @brief Check response to BT address request and update device model.
+   * 
+   * @returns device model identified (MODEL_HC05 or MODEL_HC06)
+   */
+  int finishFetchModel();
+
+  /**
+   * startFetchVersion
+   * 
+   * @brief Start AT transaction to request firmware version.
+   */
+  void startFetchVersion();
+
+  /**
+   * finishFetchVersion
+   * 
+   * @brief Parse response to firmware version request and update versionString.
+   * 
+   * @returns true if response received
+   */
+  bool finishFetchVersion();
+
+  /**
+   * versionModel
+   * 
+   * @brief Identify model of fw 2.x/3.x device from format of version string.
+   * 
+   * @returns MODEL_HC05 (+VERSION: prefix), MODEL_HC06, or MODEL_UNKNOWN if 
+   *          version string has not been read
+   */
+  int versionModel();
+
+  /**
+   * nameCommand
+   * 
+   * @brief Validate Bluetooth name and construct AT command to set name.
+   * 
+   * @param newName       desired Bluetooth name
+   * @param name          buffer (HC_NAME_MAX + 1) to store name truncated to
+   *                      supported length
+   * @param command       buffer (HC_CMD_BUFFER) to store constructed AT command
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if name is valid
+   */
+  bool nameCommand(const char *newName, char *name, char *command, bool verboseOut);
+
+  /**
+   * pinCommand
+   * 
+   * @brief Validate Bluetooth pin and construct AT command to set pin.
+   * 
+   * @param newPin        desired Bluetooth pin/passkey
+   * @param command       buffer (HC_CMD_BUFFER) to store constructed AT command
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if pin is valid
+   */
+  bool pinCommand(const char *newPin, char *command, bool verboseOut);
+
+  /**
+   * queueCommand
+   * 
+   * @brief Append AT command to pipeline (firmware 2.x/3.x only).
+   * 
+   * @param command     AT command string (including line ending)
+   * @param cmdIndex    index of AT command (as defined in HCxxCommands)
+   * 
+   * @returns true if command queued
    */
-  void changePin();
+  bool queueCommand(const char *command, int cmdIndex);
 
   /**
-   * changeParity
-   *  
-   * Configure parity of HC-xx UART.
-   * Prints menu to Serial to select desired parity for UART.
+   * finishPipeline
+   * 
+   * @brief Apply results of pipelined transaction to cached configuration.
+   *        Reconfigures Serial1 if UART configuration was accepted.
    */
-  void changeParity();
+  void finishPipeline();
 
   /**
-   * setParity
-   *  
-   * Configure parity of HC-xx UART with firmware 1.x.
-   * Sends AT command to configure parity of HC-xx UART and displays response.
-   * If successful, updates Serial1 configuration to new UART settings.
+   * checkConfig
    * 
-   * !!!!  NOTE  !!!! 
-   * Firmware version 1.x requires power-cycle of HC-06 after update to parity 
-   * settings before changes become active.
+   * @brief Validate every setting of configuration.
    * 
-   * @param parity        desired parity to configure HC-xx device UART
-   *    - 0   - NOPARITY
-   *    - 1   - ODDPARITY
-   *    - 2   - EVENPARITY
+   * @param config        requested configuration
+   * @param name          buffer (HC_NAME_MAX + 1) to store name, as written
+   * @param baudIndex     set to index of requested baud rate (unchanged if 
+   *                      baud rate not requested)
+   * @param parity        set to requested parity (unchanged if not requested)
    * @param verboseOut    if true, prints verbose output to Serial
    * 
-   * @returns true if setting parity succeeds 
+   * @returns true if every requested setting is valid
    */
-  bool setParity(int parity, bool verboseOut = false);
+  bool checkConfig(const HCConfig &config, char *name, int &baudIndex, 
+                    int &parity, bool verboseOut);
 
   /**
-   * clearStreams
+   * startApply
    * 
-   * @brief Clears Serial and Serial1 input buffers before requesting new response.
+   * @brief Start applyConfig() operation for settings marked HC_BUSY in 
+   *        _cfgResult, with requested values held in _cfgxxx.
    */
-  void clearStreams();
+  void startApply(bool verboseOut);
 
   /**
-   * clearSerial
+   * stepApplyConfig
    * 
-   * @brief Clears Serial input buffer before requesting new response.
+   * @brief Advance steps of applyConfig() operation for firmware 1.x, which
+   *        sends one command per transaction with UART configuration last.
    */
-  void clearSerial();
+  void stepApplyConfig();
 
   /**
-   * clearInputStream
+   * stepReadAll
    * 
-   * @brief Clears Serial1 input buffers before requesting new response.
-   * 
-   * @param firmware    firmware version identifier for HC-xx
+   * @brief Advance steps of readAll() operation, which sends property 
+   *        queries in pipelined bursts of up to HC_PIPELINE_MAX commands.
    */
-  void clearInputStream(int firmware);
+  void stepReadAll();
 
   /**
-   * responseDelay
-   *  
-   * @brief Delays for period necessary to allow completion of HC-xx response to command.
+   * storeProperty
    * 
-   * @param characters  count of characters in AT command
-   * @param firmware    firmware version identifier for HC-xx
-   * @param command     index of AT command (as defined in HCxxCommands)
+   * @brief Store value of +KEY:value line of readAll() response in snapshot.
+   *        Value is matched to field by key, not by order of replies.
+   * 
+   * @param line        line received (starting with '+')
+   * @param value       text following ':' of line
    */
-  void responseDelay(unsigned long characters, int firmware, int command);
+  void storeProperty(const char *line, const char *value);
 
   /**
-   * testEcho
+   * waitOperation
    * 
-   * Send AT command to test configuration of UART.
-   * If OK response not received, firmVersion set to FIRM_UNKNOWN.
+   * @brief Poll current asynchronous operation until complete.
    * 
-   * @param verboseOut     if true, prints verbose output to Serial
-   *  
-   * @returns true if responds with OK
+   * @returns true if operation succeeded
    */
-  bool testEcho(bool verboseOut = false);
+  bool waitOperation();
 
   /**
    * indexBaud
@@ -219,24 +904,6 @@ private:
   */
   int indexBaud(unsigned long baud, bool verboseOut);
 
-  /**
-   * constructUARTstring
-   *  
-   * @brief Constructs string for AT command to configure UART (for firmware vers 3.x)
-   * 
-   * @param baud    baud rate value (e.g. 57600)
-   * @param parity  parity setting
-   *                - 0 - None
-   *                - 1 - Odd parity
-   *                - 2 - Even parity
-   * @param stops   number of stop bits
-   *                - 0 - 1 bit
-   *                - 1 - 2 bits
-   * 
-   *  @returns String for AT command
-   */
-  String constructUARTstring(unsigned long baud, int parity, int stops);
-
   /**
    * printMenu
    *  
@@ -259,42 +926,188 @@ private:
   // device UART stop bit configuration
   int stopBits;
   // device firmware version string
-  String versionString;
-  // Bluetooth broadcast name
-  String btName;
+  char versionString[HC_VERSION_BUFFER];
+  // Bluetooth broadcast name (empty if not known)
+  char btName[HC_NAME_MAX + 1];
+  // Bluetooth pin/passkey (empty if not known)
+  char btPin[HC_PIN_MAX + 1];
   // UART interface for HC-0x device
-  Stream *_uart;
+  HCSerial *_uart;
   // pin connected to STATE output of HC-05
   int _statePin;
   // pin connected to EN/KEY input of HC-05
   int _keyPin;
   // current mode of HC-05, N/A for HC-06
   int _mode;
+  // time EN/KEY pin was last switched (ms)
+  unsigned long _modeSince;
+  // count of open command-mode sessions (see beginSession())
+  int _sessionDepth;
   // true if serial UART previously begun
   bool uartBegun;
   
+  // start of current wait period (ms)
+  unsigned long _waitStart;
+  // length of current wait period (ms)
+  unsigned long _waitPeriod;
+  // true once characters have been written to UART, and time of last write 
+  //  (ms), which fw 1.x idle period is measured from
+  bool _txSent;
+  unsigned long _txSentAt;
+  // state of AT transaction (as defined in HCxxTxStates)
+  int _txState;
+  // AT command of current transaction (not copied, must remain valid until
+  //  transaction is complete)
+  const char *_txCommand;
+  // length of AT command of current transaction
+  unsigned int _txCmdLength;
+  // index of AT command of current transaction (as defined in HCxxCommands)
+  int _txIndex;
+  // firmware version used for current transaction
+  int _txFirmware;
+  // response received for current transaction
+  char _txResponse[HC_RESPONSE_BUFFER];
+  // count of characters stored in _txResponse
+  unsigned int _txLength;
+  // start index of current line within _txResponse
+  unsigned int _txLineStart;
+  // true if response completed before timeout
+  bool _txComplete;
+  // true if last response ended with complete status line, so command parser
+  //  of HC-xx is known to be idle (firmware 2.x/3.x)
+  bool _rxClean;
+  // count of status lines expected for current transaction
+  int _txCount;
+  // count of status lines received for current transaction
+  int _txReplies;
+  // result of each command in transaction (HC_IDLE, HC_SUCCESS, HC_FAILED)
+  int _txStatus[HC_PIPELINE_MAX];
+  // reason for failure of each command in transaction
+  HCError _txError[HC_PIPELINE_MAX];
+#ifdef HC_TX_STATS
+  // latency of transactions, indexed by command (as defined in HCxxCommands)
+  HCTxStats _txStats[HC_CMD_CNT];
+#endif
+  // single-command transactions and pipelines never share a transaction, so
+  //  their command texts share storage (queued commands not yet sent are 
+  //  discarded when another operation starts)
+  union {
+    // buffer for AT command constructed for single-command transaction
+    char _cmdBuffer[HC_CMD_BUFFER];
+    // AT commands queued for pipelined transaction
+    char _pipeCommands[HC_CMD_BUFFER * HC_PIPELINE_MAX];
+  };
+  // index of each queued command (as defined in HCxxCommands)
+  int _pipeIndex[HC_PIPELINE_MAX];
+  // result of each command of last pipeline (HC_IDLE, HC_SUCCESS, HC_FAILED)
+  int _pipeStatus[HC_PIPELINE_MAX];
+  // reason for failure of each command of last pipeline
+  HCError _pipeError[HC_PIPELINE_MAX];
+  // properties read by last readAll()
+  HCSnapshot _snapshot;
+  // index of next property query of readAll() (within propertyQueries)
+  int _snapNext;
+  // count of queued commands
+  int _pipeCount;
+  // true once queued commands have been sent
+  bool _pipeSent;
+  // Bluetooth name queued in pipeline
+  char _pipeName[HC_NAME_MAX + 1];
+  // current asynchronous operation (HC_OP_xxx)
+  int _op;
+  // current step of asynchronous operation (as defined in HCxxSteps)
+  int _opStep;
+  // result of asynchronous operation (HC_IDLE, HC_BUSY, HC_SUCCESS, HC_FAILED)
+  int _opResult;
+  // result of operation, false once any step of operation has failed
+  bool _opSuccess;
+  // verbose output requested for current operation
+  bool _opVerbose;
+  // count of commands resent by current operation
+  int _opRetries;
+  // firmware version currently tested by detection scan
+  int _scanFirmware;
+  // position of detection scan (hint probes, then full scan)
+  int _probeStep;
+  // bit set for each combination tested by detection scan (SCAN_CELL_CNT bits)
+  uint8_t _probed[6];
+  // parity settings left to test at baud rate of garbled reply
+  int _parityChecks;
+  // parity of probe which received garbled reply
+  int _garbledParity;
+  // count of probe transactions of current or last detection
+  unsigned int _probeCount;
+  // baud rates estimated from mis-framed response, most likely first
+  //  (BAUD_LIST_CNT - VERS2_MIN_BAUD entries)
+  int8_t _baudGuess[6];
+  // count of estimated baud rates, and count already tested
+  int _guessCnt;
+  int _guessStep;
+  // firmware version and parity of probe which received mis-framed response
+  int _guessFirmware;
+  int _guessParity;
+  // UART configuration tested first by detection (FIRM_UNKNOWN if no hint)
+  int _hintFirmware;
+  int _hintBaud;
+  int _hintParity;
+  // device model identified at hint (MODEL_UNKNOWN if not yet identified)
+  int _hintModel;
+  // EEPROM address of stored hint, or -1 if not stored
+  int _hintAddress;
+  // requested baud rate index for configUART() operation
+  int _cfgBaud;
+  // requested parity for configUART() operation
+  int _cfgParity;
+  // requested role for setRole() operation
+  int _cfgRole;
+  // requested or staged name of applyConfig(), commit() or setName()
+  char _cfgName[HC_NAME_MAX + 1];
+  // requested or staged pin of applyConfig(), commit() or setPin()
+  char _cfgPin[HC_PIN_MAX + 1];
+  // result of each setting of applyConfig() (HC_BUSY until written)
+  HCConfigResult _cfgResult;
+  // true if current applyConfig() operation was started by commit()
+  bool _cfgCommit;
+  // settings staged by stageConfig() (HC_SNAP_xxx flags)
+  uint8_t _staged;
+  // staged settings, written by commit() where they differ from cache (name
+  //  and pin are staged in _cfgName and _cfgPin)
+  int _stageRole;
+  int _stageBaud;
+  int _stageParity;
+  // function called when asynchronous operation completes
+  HCCallback _callback;
+  // time source for waits and timeouts
+  HCClock *_clock;
+
 public:
-  /* 
-   * Create instance of HCBT class.  
-   * UART interface may be HardwareSerial or SoftwareSerial object,
-   * Serial1 is default.
+  /** 
+   * @brief Create instance of HCBT class on specified UART.
    * 
-   * @param uart        serial interface for HC-0x (Serial1 is default)
+   * UART must be a hardware serial port (e.g. Serial2 of Mega), since it is
+   * reconfigured to the baud rate and parity of HC-0x device. Instances on 
+   * separate UARTs may run asynchronous operations concurrently (see HCManager).
+   * UART is passed by reference, so a null or integer argument cannot be taken
+   * for it (HCBT(0) selects the constructor with pins, on Serial1).
+   * 
+   * @param uart        serial interface for HC-0x (e.g. Serial2)
    * @param keyPin      pin conencted to EN/KEY input of HC-05 (not used for HC-06)
    * @param statePin    pin conencted to STATE output of HC-05 (not used for HC-06)
    */
-  // TODO add support for specifying UART for AT communication
-  //  HCBT(Stream * uart = &Serial1, int keyPin = 0, int statePin = 0);
+  HCBT(HCSerial &uart, int keyPin = 0, int statePin = 0);
 
   /** 
    * @brief Default HCBT constructor.
    * 
    * Uses Serial1 for UART connection. Pin values are optional, defaults to 0.
+   * Not available in HC_TERMIOS builds, which have no default port.
    * 
    * @param keyPin      pin conencted to EN/KEY input of HC-05 (not used for HC-06)
    * @param statePin    pin conencted to STATE output of HC-05 (not used for HC-06)
    */
-  HCBT(int keyPin = 0, int statePin = 0);
+#ifndef HC_TERMIOS
+  explicit HCBT(int keyPin = 0, int statePin = 0);
+#endif
 
   /**
    * @brief Print user menu with config options to Serial and handle selection.
@@ -305,7 +1118,8 @@ public:
    * @brief Automated scan of Bluetooth module to determine configuration of UART.
    * 
    * Will identify version of firmware, baud rate, and parity setting, and set
-   * Serial1 to match HC-xx UART settings.
+   * Serial1 to match HC-xx UART settings. Blocks until complete, see
+   * beginDetect() for non-blocking alternative.
    * 
    * @param verboseOut     if true, prints verbose output to Serial
    * 
@@ -358,6 +1172,7 @@ public:
    * 
    * Sends AT command(s) to configure baud rate and parity of HC-xx UART.
    * If successful, updates Serial1 configuration to new UART settings.
+   * No command is sent if device already uses requested settings.
    * 
    * !!!!  NOTE  !!!! 
    * Firmware version 1.x requires power-cycle of HC-06 after update to parity 
@@ -379,7 +1194,8 @@ public:
    * 
    * Sends AT command to set Bluetooth broadcast name of HC-xx device. Some 
    * devices with firmware version 1.x exhibited failures when trying to set 
-   * name to more than 14 characters with higher baud rates.
+   * name to more than 14 characters with higher baud rates. No command is 
+   * sent if name matches cached name (see cacheValid()).
    * 
    * @param newName       desired Bluetooth name to configure HC-xx device
    * @param verboseOut    if true, prints verbose output to Serial
@@ -395,7 +1211,8 @@ public:
    * For firmware version 1.x, 4-digit code is accepted. For firmware version
    * 3.x, up to 16 alphanumeric character passkey is accepted according to 
    * documentation. This is artificially limited to 14 characters to ensure no
-   * conflict with adding quotation characters.
+   * conflict with adding quotation characters. No command is sent if pin
+   * matches cached pin (see cacheValid()).
    * 
    * @param newPin        desired Bluetooth pin/passkey for HC-xx device
    * @param verboseOut    if true, prints verbose output to Serial
@@ -404,6 +1221,388 @@ public:
    */
   bool setPin(String newPin, bool verboseOut);
 
+  /**
+   * @brief Provide likely UART configuration of HC-xx, tested first by detectDevice().
+   * 
+   * Detection tests hinted configuration, then neighboring baud rates, parity
+   * settings and firmware version, before falling back to full scan. Hint is
+   * updated automatically each time UART configuration is detected or changed.
+   * 
+   * @param baud        likely baud rate of HC-xx device UART (e.g. 9600)
+   * @param parity      likely parity of HC-xx device UART (0 - None, 1 - Odd, 2 - Even)
+   */
+  void setDetectHint(unsigned long baud, int parity);
+
+  /**
+   * @brief Persist detection hint in EEPROM, so warm detection after reset
+   *        needs a single transaction.
+   * 
+   * Loads hint stored at address (if valid), and stores hint there whenever
+   * it changes. Uses 5 bytes of EEPROM (including device model, so model is
+   * not queried again). Supported on AVR boards only.
+   * 
+   * @param address     EEPROM address of hint
+   * 
+   * @returns true if EEPROM is supported and a valid hint was loaded
+   */
+  bool useEEPROMHint(int address);
+
+  /**
+   * @returns count of probe transactions (AT sent to test a UART 
+   *          configuration, including fw 2.x/3.x terminator and retries) of
+   *          current or last detection
+   */
+  unsigned int detectProbes();
+
+  /**
+   * @brief Start non-blocking detectDevice() operation.
+   * 
+   * Call poll() from loop() until operation completes.
+   * 
+   * @param verboseOut     if true, prints verbose output to Serial
+   * 
+   * @returns true if operation started (false if another operation is busy)
+   */
+  bool beginDetect(bool verboseOut = false);
+
+  /**
+   * @brief Start non-blocking configUART() operation.
+   * 
+   * Call poll() from loop() until operation completes. For firmware 1.x with
+   * verbose output, operation waits for character on Serial after request
+   * to power-cycle HC-06.
+   * 
+   * @param baud        desired buad rate to configure HC-xx device UART (e.g. 9600)
+   * @param parity      desired parity to configure HC-xx device UART
+   * @param verboseOut  if true, prints verbose output to Serial
+   * 
+   * @returns true if operation started (false if busy or invalid settings)
+   */
+  bool beginConfigUART(unsigned long baud, int parity, bool verboseOut = false);
+
+  /**
+   * @brief Start non-blocking setName() operation.
+   * 
+   * @param newName       desired Bluetooth name to configure HC-xx device
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if operation started (false if busy or invalid name)
+   */
+  bool beginSetName(String newName, bool verboseOut = false);
+
+  /**
+   * @brief Start non-blocking setPin() operation.
+   * 
+   * @param newPin        desired Bluetooth pin/passkey for HC-xx device
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if operation started (false if busy or invalid pin)
+   */
+  bool beginSetPin(String newPin, bool verboseOut = false);
+
+  /**
+   * @brief Start non-blocking setRole() operation.
+   * 
+   * @param role          role to set HC-05 device (ROLE_xxx)
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if operation started (false if busy or role not supported)
+   */
+  bool beginSetRole(int role, bool verboseOut = false);
+
+  /**
+   * @brief Queue command to set Bluetooth name in pipeline.
+   * 
+   * Pipelined commands are sent back-to-back in a single transaction by 
+   * sendPipeline() or beginPipeline(), and their responses are matched to
+   * the commands in order. Pipelining requires firmware 2.x/3.x. A command
+   * queued after a pipeline has been sent starts a new pipeline. Commands
+   * not yet sent are discarded if another operation is started first.
+   * 
+   * @param newName       desired Bluetooth name to configure HC-xx device
+   * 
+   * @returns true if command queued (false if firmware 1.x, pipeline full, or
+   *          invalid name)
+   */
+  bool queueName(String newName);
+
+  /**
+   * @brief Queue command to set Bluetooth pin/passkey in pipeline.
+   * 
+   * @param newPin        desired Bluetooth passkey for HC-xx device
+   * 
+   * @returns true if command queued
+   */
+  bool queuePin(String newPin);
+
+  /**
+   * @brief Queue command to set BT role of HC-05 device in pipeline.
+   * 
+   * @param role          role to set HC-05 device (ROLE_xxx)
+   * 
+   * @returns true if command queued (false if device is not HC-05)
+   */
+  bool queueRole(int role);
+
+  /**
+   * @brief Queue command to configure baud rate and parity of HC-xx UART.
+   * 
+   * UART configuration must be last command of pipeline, since HC-xx 
+   * responds to subsequent commands with new settings. No further commands
+   * may be queued once UART command is queued.
+   * 
+   * @param baud        desired buad rate to configure HC-xx device UART (e.g. 9600)
+   * @param parity      desired parity to configure HC-xx device UART
+   * 
+   * @returns true if command queued
+   */
+  bool queueUART(unsigned long baud, int parity);
+
+  /**
+   * @brief Start non-blocking transmission of queued pipeline commands.
+   * 
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if operation started (false if busy or pipeline empty)
+   */
+  bool beginPipeline(bool verboseOut = false);
+
+  /**
+   * @brief Send queued pipeline commands and wait for all responses.
+   * 
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if every queued command succeeded
+   */
+  bool sendPipeline(bool verboseOut = false);
+
+  /**
+   * @brief Returns result of command within last pipeline.
+   * 
+   * @param index         position of command within pipeline (from 0)
+   * 
+   * @returns HC_SUCCESS, HC_FAILED, or HC_IDLE if no response received
+   */
+  int pipelineResult(int index);
+
+  /**
+   * @brief Returns reply to command within last pipeline, including reason 
+   *        for failure.
+   * 
+   * @param index         position of command within pipeline (from 0)
+   * 
+   * @returns status (as pipelineResult()) and error code of command
+   */
+  HCReply pipelineReply(int index);
+
+  /**
+   * @brief Returns reply to last AT command sent, including reason for 
+   *        failure (e.g. HC_ERR_PSWD_LONG for ERROR:(10) status).
+   */
+  HCReply lastReply();
+
+  /**
+   * @brief Returns description of error code, for printing.
+   * 
+   * @param error         error code (HC_ERR_xxx)
+   */
+  static const __FlashStringHelper *errorString(HCError error);
+
+  /**
+   * @brief Apply several settings to HC-xx device in a single command-mode session.
+   * 
+   * Only settings which differ from cached configuration are written (pin is
+   * written unless known from an earlier write or readAll()). For 
+   * firmware 2.x/3.x, settings are sent as one pipelined transaction. UART 
+   * configuration is always written last, so Serial1 is reconfigured once.
+   * Result of each setting is available from configResult().
+   * 
+   * @param config        desired configuration of HC-xx device
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if every requested setting succeeds
+   */
+  bool applyConfig(const HCConfig &config, bool verboseOut = false);
+
+  /**
+   * @brief Start non-blocking applyConfig() operation.
+   * 
+   * All settings are validated before any command is sent.
+   * 
+   * @param config        desired configuration of HC-xx device
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if operation started (false if busy or invalid settings)
+   */
+  bool beginApplyConfig(const HCConfig &config, bool verboseOut = false);
+
+  /**
+   * @brief Returns result of each setting of last applyConfig().
+   */
+  HCConfigResult configResult();
+
+  /**
+   * @brief Stage settings to be written by commit(). Settings left at 
+   *        default values in config keep any value staged previously, 
+   *        including settings whose write failed, which remain staged until
+   *        written or discarded with clearStaged(). A name or pin written
+   *        by setName(), setPin() or applyConfig() replaces the staged one.
+   *        Requires detected device, since valid settings depend on model 
+   *        and firmware.
+   * 
+   * @param config        desired configuration of HC-xx device
+   * 
+   * @returns true if every requested setting is valid (nothing is staged 
+   *          otherwise)
+   */
+  bool stageConfig(const HCConfig &config);
+
+  /**
+   * @brief Discard all staged settings (e.g. settings left staged by a 
+   *        failed commit, before staging configuration of another module).
+   */
+  void clearStaged();
+
+  /**
+   * @brief Write staged settings which differ from cached configuration
+   *        (see cacheDirty()), as applyConfig(). Each setting written 
+   *        successfully is no longer staged; failed settings remain staged.
+   * 
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if every dirty setting was written
+   */
+  bool commit(bool verboseOut = false);
+
+  /**
+   * @brief Start non-blocking commit() operation.
+   * 
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if operation started (false if busy or device not detected)
+   */
+  bool beginCommit(bool verboseOut = false);
+
+  /**
+   * @brief Returns settings of cached configuration known to match device
+   *        (HC_SNAP_NAME, HC_SNAP_PIN, HC_SNAP_ROLE and HC_SNAP_UART flags).
+   *        Filled by detection (UART, role), readAll(), and each successful
+   *        write. Detection clears cached name and pin.
+   */
+  uint8_t cacheValid();
+
+  /**
+   * @brief Returns staged settings which differ from cached configuration,
+   *        or are not known to match device (HC_SNAP_xxx flags).
+   */
+  uint8_t cacheDirty();
+
+  /**
+   * @brief Read all properties of firmware 2.x/3.x device (name, pin, UART,
+   *        address, class, connection mode, bound address and role), sent
+   *        as pipelined queries in a single command-mode session. Discards
+   *        commands queued for pipeline. Cached name and role are updated.
+   * 
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if device replied to every query (see snapshot() for 
+   *          properties supported by device)
+   */
+  bool readAll(bool verboseOut = false);
+
+  /**
+   * @brief Start non-blocking readAll() operation.
+   * 
+   * @param verboseOut    if true, prints verbose output to Serial
+   * 
+   * @returns true if operation started (false if busy or firmware 1.x)
+   */
+  bool beginReadAll(bool verboseOut = false);
+
+  /**
+   * @brief Returns properties read by last readAll().
+   */
+  const HCSnapshot &snapshot();
+
+  /**
+   * @brief Advance asynchronous operation. Call repeatedly from loop().
+   * 
+   * Never blocks for response of HC-xx device. Calls completion callback
+   * (see setCallback()) once when operation completes.
+   * 
+   * @returns status of current or last operation:
+   *    - HC_IDLE     - no operation started
+   *    - HC_BUSY     - operation in progress
+   *    - HC_SUCCESS  - operation completed successfully
+   *    - HC_FAILED   - operation failed
+   */
+  int poll();
+
+  /**
+   * @brief Returns true while an asynchronous operation is in progress.
+   */
+  bool busy();
+
+  /**
+   * @brief Returns identifier of current or last operation (HC_OP_xxx).
+   */
+  int operation();
+
+  /**
+   * @brief Set function called when asynchronous operation completes.
+   * 
+   * Also called for blocking methods, which are implemented as asynchronous
+   * operations polled until complete.
+   * 
+   * @param callback    function to call, or NULL to disable
+   */
+  void setCallback(HCCallback callback);
+
+  /**
+   * @brief Set time source used for all waits and timeouts, e.g. a 
+   *        HCVirtualClock for host builds. Call while no operation is busy.
+   * 
+   * @param clock       time source, or NULL for HCArduinoClock (default)
+   */
+  void setClock(HCClock *clock);
+
+#ifdef HC_TX_STATS
+  /**
+   * @brief Latency of AT transactions for command index, for comparison of
+   *        module response times with responseMS[] budgets. Available if 
+   *        built with HC_TX_STATS defined.
+   * 
+   * @param command     command index (as defined in HCxxCommands)
+   * 
+   * @returns timestamps of last transaction, and counts by outcome
+   */
+  const HCTxStats &txStats(int command);
+
+  /**
+   * @brief Clear latency records of all commands.
+   */
+  void resetTxStats();
+#endif
+
+  /**
+   * @brief Open command-mode session spanning several operations.
+   * 
+   * Each operation normally returns HC-05 to data mode when complete. While
+   * a session is open, HC-05 remains in command mode between operations, so
+   * EN/KEY pin is switched (and allowed to settle) only once. Sessions may be
+   * nested; HC-05 returns to data mode when outermost session ends. See
+   * HCCommandSession for scoped use.
+   */
+  void beginSession();
+
+  /**
+   * @brief Close command-mode session opened by beginSession().
+   * 
+   * When outermost session is closed and no operation is busy, places HC-05
+   * in data mode.
+   */
+  void endSession();
+
   /**
    * @brief Set EN pin high to place HC-05 in command mode.
    */
@@ -432,4 +1631,35 @@ public:
 
 };
 
+
+/**
+ * HCCommandSession class
+ * 
+ * Scoped command-mode session. Holds HC-05 in command mode from construction
+ * until destruction, across all operations within scope.
+ */
+class HCCommandSession
+{
+private:
+  // device held in command mode
+  HCBT &_device;
+
+  // sessions are not copied, since each must be closed exactly once
+  HCCommandSession(const HCCommandSession &);
+  HCCommandSession &operator=(const HCCommandSession &);
+
+public:
+  /**
+   * @brief Open command-mode session of HC-xx device.
+   * 
+   * @param device      HCBT instance to hold in command mode
+   */
+  HCCommandSession(HCBT &device);
+
+  /**
+   * @brief Close command-mode session, see HCBT::endSession().
+   */
+  ~HCCommandSession();
+};
+
 #endif // CONFIGUREBT_H
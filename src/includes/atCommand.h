@@ -0,0 +1,161 @@
+/**
+ * @file atCommand.h
+ *
+ *  Description: Compile-time AT command builders for HC-05/06 AT Command Center.
+ *
+ *    AtCmd<command, firmware> holds the fixed text of each AT command (prefix
+ *    and terminator) in flash, with lengths known at compile time. Only the
+ *    argument of the command is formatted at runtime, into a caller-supplied
+ *    buffer of HC_CMD_BUFFER characters. For example:
+ *
+ *      AtCmd<BAUD_SET, FIRM_VERSION2>::format(buffer, 9600, STOP1BIT, NOPARITY);
+ *
+ *    produces "AT+UART=9600,0,0\r\n".
+ */
+
+#ifndef ATCOMMAND_H
+#define ATCOMMAND_H
+
+#include "../configureBT.h"
+#include "constants.h"
+
+/**
+ * AtCmdText template
+ *
+ * Fixed text of AT command, specialized for each supported combination of
+ * command (as defined in HCxxCommands) and firmware version. Texts are 
+ * namespace-scope PROGMEM arrays rather than PSTR() within the inline 
+ * members, since avr-gcc reports a section type conflict when PSTR() is used
+ * in inline functions and in ordinary functions of the same file.
+ */
+template <int CMD, int FIRMWARE> struct AtCmdText;
+
+#define AT_CMD_TEXT(cmd, firmware, pre, post)                                 \
+  const char atCmdPrefix_##cmd##_##firmware[] PROGMEM = pre;                  \
+  const char atCmdSuffix_##cmd##_##firmware[] PROGMEM = post;                 \
+  template <> struct AtCmdText<cmd, firmware> {                               \
+    enum { prefixLen = sizeof(pre) - 1, suffixLen = sizeof(post) - 1 };       \
+    static const char *prefix() { return atCmdPrefix_##cmd##_##firmware; }    \
+    static const char *suffix() { return atCmdSuffix_##cmd##_##firmware; }    \
+  };
+
+AT_CMD_TEXT(ECHO,       FIRM_VERSION1,  "AT",           ENDLINE_NONE)
+AT_CMD_TEXT(ECHO,       FIRM_VERSION2,  "AT",           ENDLINE_NLCR)
+AT_CMD_TEXT(HCVERSION,  FIRM_VERSION1,  "AT+VERSION",   ENDLINE_NONE)
+AT_CMD_TEXT(HCVERSION,  FIRM_VERSION2,  "AT+VERSION?",  ENDLINE_NLCR)
+AT_CMD_TEXT(BTNAME,     FIRM_VERSION1,  "AT+NAME",      ENDLINE_NONE)
+AT_CMD_TEXT(BTNAME,     FIRM_VERSION2,  "AT+NAME=",     ENDLINE_NLCR)
+AT_CMD_TEXT(BTPIN,      FIRM_VERSION1,  "AT+PIN",       ENDLINE_NONE)
+// version 3.x FW appears to require quotes around passkey,
+//  though this isn't indicated in documentation
+//  https://forum.arduino.cc/t/password-hc-05/481294
+AT_CMD_TEXT(BTPSWD,     FIRM_VERSION2,  "AT+PSWD=\"",   "\"" ENDLINE_NLCR)
+AT_CMD_TEXT(BAUD_SET,   FIRM_VERSION1,  BAUD_CMD,       ENDLINE_NONE)
+AT_CMD_TEXT(BAUD_SET,   FIRM_VERSION2,  UART_CMD,       ENDLINE_NLCR)
+AT_CMD_TEXT(PARITY_SET, FIRM_VERSION1,  "AT+P",         ENDLINE_NONE)
+AT_CMD_TEXT(ROLE_SET,   FIRM_VERSION2,  ROLE_CMD,       ENDLINE_NLCR)
+AT_CMD_TEXT(ADDR_GET,   FIRM_VERSION2,  "AT+ADDR?",     ENDLINE_NLCR)
+
+#undef AT_CMD_TEXT
+
+/**
+ * AtCmd template
+ *
+ * Formats AT command into caller-supplied buffer (HC_CMD_BUFFER characters).
+ * Arguments which would overflow the buffer are truncated.
+ *
+ * @returns pointer to command (start of buffer)
+ */
+template <int CMD, int FIRMWARE>
+class AtCmd
+{
+private:
+  typedef AtCmdText<CMD, FIRMWARE> Text;
+
+  // characters available for argument of command
+  enum { argChars = HC_CMD_BUFFER - 1 - Text::prefixLen - Text::suffixLen };
+
+  static char *start(char *command) {
+    memcpy_P(command, Text::prefix(), Text::prefixLen);
+    return command + Text::prefixLen;
+  }
+
+  static char *finish(char *command, char *end) {
+    memcpy_P(end, Text::suffix(), Text::suffixLen);
+    end[Text::suffixLen] = '\0';
+    return command;
+  }
+
+  static char *number(char *end, const char *limit, unsigned long value) {
+    char digits[10];
+    int count = 0;
+
+    do {
+      digits[count++] = '0' + (value % 10);
+      value /= 10;
+    } while (value > 0);
+    while ((count > 0) && (end < limit)) {
+      *end++ = digits[--count];
+    }
+    return end;
+  }
+
+public:
+  /**
+   * @brief Format command without argument (e.g. "AT+VERSION?\r\n").
+   */
+  static char *format(char *command) {
+    return finish(command, start(command));
+  }
+
+  /**
+   * @brief Format command with string argument (e.g. name or passkey).
+   *
+   * @param maxChars    maximum characters of argument included
+   */
+  static char *format(char *command, const char *arg, unsigned int maxChars = argChars) {
+    char *end = start(command);
+
+    if (maxChars > argChars)  maxChars = argChars;
+    while ((*arg != '\0') && (maxChars-- > 0)) {
+      *end++ = *arg++;
+    }
+    return finish(command, end);
+  }
+
+  /**
+   * @brief Format command with numeric argument (e.g. role or baud index).
+   */
+  static char *format(char *command, long value) {
+    char *end = start(command);
+
+    end = number(end, command + Text::prefixLen + argChars, value);
+    return finish(command, end);
+  }
+
+  /**
+   * @brief Format command with three comma separated numeric arguments
+   *        (AT+UART=baud,stop,parity).
+   */
+  static char *format(char *command, unsigned long first, long second, long third) {
+    char *end = start(command);
+    const char *limit = command + Text::prefixLen + argChars;
+
+    end = number(end, limit, first);
+    if (end < limit)  *end++ = ',';
+    end = number(end, limit, second);
+    if (end < limit)  *end++ = ',';
+    end = number(end, limit, third);
+    return finish(command, end);
+  }
+};
+
+/**
+ * Format command for firmware version known only at runtime. Requires 
+ * AtCmdText for both FIRM_VERSION1 and FIRM_VERSION2.
+ */
+#define AT_FORMAT(cmd, firmware, ...)                                         \
+  (((firmware) == FIRM_VERSION2) ? AtCmd<cmd, FIRM_VERSION2>::format(__VA_ARGS__) \
+                                 : AtCmd<cmd, FIRM_VERSION1>::format(__VA_ARGS__))
+
+#endif // ATCOMMAND_H
@@ -24,6 +24,8 @@
 #define ENDLINE_NLCR    "\r\n"    // for firmware version 2/3
 #define ENDLINE_NONE    ""        // for firmware version 1
 #define STATUS_OK       "OK"
+#define STATUS_ERROR    "ERROR"
+#define VERSION_HC05    "+VERSION:"   // prefix of HC-05 version, HC-06 fw 2.x replies hcXX.comV2.x
 #define UART_CMD        "AT+UART="
 #define BAUD_CMD        "AT+BAUD"
 #define ROLE_CMD        "AT+ROLE="
@@ -39,31 +41,33 @@
 #define CONFIG_DELAY    20      // delay for basic configuration changes
 #define SHORT_DELAY     100     // brief delay constant for UI
 #define MENU_DELAY      2000    // delay before returning to menu after fault
-#define FW1_RESPONSE    550     // for firmware version 1
+#define FW1_CMD_IDLE    500     // fw version 1 executes command once idle for this period
+#define FW1_RESPONSE    (FW1_CMD_IDLE + 50)   // for firmware version 1
 #define FW2_RESPONSE    40      // for firmware version 2/3
 #define BITS_PER_CHAR   12      // UART frames - worst case: parity, 2 stop bits
+#define IDLE_GAP_CHARS  3       // idle character periods marking end of fw 1.x response
+#define CMD_RETRY_MAX   1       // resends of command failed with transient error
 
 // macros for determining if firmware of connected device is known
 #define VERSION_KNOWN   (firmVersion != FIRM_UNKNOWN)
 #define VERSION_UNKNOWN (firmVersion == FIRM_UNKNOWN)
 
-// constant arrays for configuration and AT command construction
+// String tables are stored in flash as fixed-width character arrays, so they
+//  use no SRAM and need no construction at startup. Read entries with 
+//  flashStr() for printing, or with strcpy_P()/strcat_P() to build commands.
+#define flashStr(table, index)  (reinterpret_cast<const __FlashStringHelper *>((table)[index]))
+
+// constant arrays for configuration (AT commands are built by AtCmd, see atCommand.h)
 const unsigned long baudRateList[] = {1200, 2400, 4800, 9600, 19200, 
                                         38400, 57600, 115200};
 const uint32_t parityList[] = {SERIAL_8N1, SERIAL_8O1, SERIAL_8E1};
-const String parityType[] = {"None", "Odd", "Even"};
-const String parityCmd[] =  {"AT+PN", "AT+PO", "AT+PE"};
-const String roleString[] = {"Secondary", "Primary", "Secondary-Loop"};
-const String lineEnding[] = {"", "", "\r\n"};
-const String requestVal[] = {"", "", "?\r\n"};
-const String setValue[] =   {"", "", "="};
-const String namePrefix[] = {"HCxx_", "HC06_", "HC05_"};
-const String responsePrefix[] = {"[HC0x]: ", "[HC06]: ", "[HC05]: "};
-const String atCommands[] = { "AT", 
-                              "AT+VERSION", 
-                              "AT+NAME", 
-                              "AT+PIN",
-                              "AT+PSWD"};
+const char parityType[][5] PROGMEM = {"None", "Odd", "Even"};
+const char parityCode[] PROGMEM = "NOE";          // argument of AT+Px (fw 1.x)
+const char roleString[][15] PROGMEM = {"Secondary", "Primary", "Secondary-Loop"};
+const char namePrefix[][6] PROGMEM = {"HCxx_", "HC06_", "HC05_"};
+const char responsePrefix[][9] PROGMEM = {"[HC0x]: ", "[HC06]: ", "[HC05]: "};
+// status lines which parity-garbled replies are matched against ('#' - hex digit)
+const char garbledStatus[][11] PROGMEM = {STATUS_OK, STATUS_ERROR ":(##)"};
 
 // indexes for AT commands within constant arrays
 enum HCxxCommands {ECHO = 0,
@@ -74,8 +78,54 @@ enum HCxxCommands {ECHO = 0,
                   UART_GET,
                   BAUD_SET,
                   PARITY_SET,
+                  ROLE_SET,
+                  ADDR_GET,
                   OTHER_CMD};
 
+// states of AT transaction engine
+enum HCxxTxStates {TX_IDLE = 0,
+                  TX_MODE,          // waiting for EN/KEY pin to settle
+                  TX_FLUSH,         // waiting for HC-xx to discard partial command
+                  TX_WAIT,          // waiting for response
+                  TX_RECEIVE,       // receiving fw 1.x response until UART idle
+                  TX_DONE};
+
+// types of line within firmware 2.x/3.x response
+enum HCxxLineTypes {LINE_OTHER = 0,
+                    LINE_VALUE,       // +KEY:value
+                    LINE_OK,          // OK status
+                    LINE_ERROR};      // ERROR:(x) status
+
+// steps of asynchronous operations
+enum HCxxSteps {STEP_IDLE = 0,
+                STEP_FINISH,        // waiting for data mode before completion
+                STEP_TRANSACTION,   // single AT transaction (name, pin, role)
+                DETECT_START,
+                DETECT_END_UART,
+                DETECT_BEGIN_UART,
+                DETECT_PROBE,
+                DETECT_PROBE_WAIT,
+                DETECT_ROLE,
+                DETECT_MODEL,
+                DETECT_VERSION,
+                DETECT_ECHO,
+                CONFIG_START,
+                CONFIG_BAUD_WAIT,
+                CONFIG_PARITY_WAIT,
+                CONFIG_POWER_CYCLE,
+                CONFIG_BEGIN_UART,
+                CONFIG_TEST,
+                CONFIG_TEST_WAIT,
+                FETCH_ROLE_WAIT,
+                FETCH_VERSION_WAIT,
+                FETCH_ECHO_WAIT,
+                PIPELINE_WAIT,
+                APPLY_NEXT,         // next setting of applyConfig() (firmware 1.x)
+                APPLY_NAME_WAIT,
+                APPLY_PIN_WAIT,
+                SNAPSHOT_NEXT,      // next burst of readAll() queries
+                SNAPSHOT_WAIT};
+
 // Worst-case count of expected characters for response to commands.
 //  Indexed based on HCxxCommands values.
 const int responseChars[] = {
@@ -87,8 +137,104 @@ const int responseChars[] = {
                             22,     // AT+UART
                             8,      // AT+UART
                             8,      // AT+UART
+                            4,      // AT+ROLE
+                            28,     // AT+ADDR?
                             40};    // other
 
+// Property queries of readAll() (firmware 2.x/3.x), and key of each reply
+//  (+KEY:value). Position in table is bit of field in HCSnapshot::valid.
+const char propertyQueries[][10] PROGMEM = {"AT+NAME?", "AT+PSWD?", "AT+UART?", 
+                                            "AT+ADDR?", "AT+CLASS?", "AT+CMODE?",
+                                            "AT+BIND?", "AT+ROLE?"};
+// firmware 3.x replies +PIN:"x" to AT+PSWD?, and +CMOD:x to AT+CMODE?
+const char propertyKeys[][6] PROGMEM = {"NAME", "PSWD", "UART", "ADDR", "CLASS",
+                                        "CMOD", "BIND", "ROLE"};
+#define PROPERTY_CNT    (sizeof(propertyQueries) / sizeof(propertyQueries[0]))
+#define PIN_KEY         "PIN:"
+
+// Probes following hinted UART configuration in detection scan, as offsets of
+//  {baud index, parity, firmware} from hint (parity wraps, firmware toggles)
+const int8_t hintOffsets[][3] = {{0, 0, 0},     // hinted configuration
+                                 {-1, 0, 0},    // neighboring baud rates
+                                 {1, 0, 0},
+                                 {0, 1, 0},     // other parity settings
+                                 {0, 2, 0},
+                                 {0, 0, 1}};    // other firmware version
+#define HINT_PROBE_CNT  (sizeof(hintOffsets) / sizeof(hintOffsets[0]))
+// Passes of full detection scan, as {firmware, parity}, each sweeping baud rates
+//  upward. All firmware 2.x/3.x passes precede firmware 1.x, since a fw 2.x/3.x
+//  probe answers within FW2_RESPONSE, while each fw 1.x probe waits out its 
+//  idle window (the line is also held idle after CRLF of fw 2.x/3.x probes, see
+//  HCBT::stepDetect). Baud rate is first found with parity None, since a reply
+//  received under wrong parity is garbled but still recognizable (see 
+//  HCBT::responseGarbled); other parity settings are then only tested at that 
+//  baud rate. Passes with odd/even parity remain as fallback.
+const int8_t scanPasses[][2] = {{FIRM_VERSION2, NOPARITY},
+                                {FIRM_VERSION2, ODDPARITY},
+                                {FIRM_VERSION2, EVENPARITY},
+                                {FIRM_VERSION1, NOPARITY},
+                                {FIRM_VERSION1, ODDPARITY},
+                                {FIRM_VERSION1, EVENPARITY}};
+#define SCAN_PASS_CNT   (sizeof(scanPasses) / sizeof(scanPasses[0]))
+// count of (firmware, parity, baud) combinations of full detection scan
+#define SCAN_CELL_CNT   (2 * PARITY_LIST_CNT * (BAUD_LIST_CNT - VERS2_MIN_BAUD))
+#define HINT_MAGIC      0xC5    // marks valid hint stored in EEPROM
+
+// Characters received for start of OK and ERROR status lines when Serial1 is
+//  mis-framed, i.e. HC-0x replies at different baud rate than probe. Entries 
+//  are {count, first, second}, indexed [probe baud][HC-0x baud][OK, ERROR] 
+//  from VERS2_MIN_BAUD, for 8N1 frames sampled at middle of each bit. Values 
+//  depend only on ratio of baud rates, used by HCBT::estimateBaud. Table is 
+//  derived from the same ideal UART model as HCSimulator::misframe(), and has
+//  not been validated against captures of real HC-0x modules.
+#define MISFRAMED_STATUS_CNT  2
+const uint8_t misframedStatus[BAUD_LIST_CNT - VERS2_MIN_BAUD]
+                             [BAUD_LIST_CNT - VERS2_MIN_BAUD]
+                             [MISFRAMED_STATUS_CNT][3] PROGMEM = {
+    // probe at 4800, device at 4800 ... 115200
+    {{{0, 0x00, 0x00}, {0, 0x00, 0x00}},
+     {{2, 0x2D, 0xCC}, {2, 0x71, 0x18}},
+     {{1, 0xA3, 0x00}, {2, 0x90, 0x2C}},
+     {{1, 0xFB, 0x00}, {2, 0x21, 0xFB}},
+     {{1, 0xFC, 0x00}, {1, 0x9C, 0x00}},
+     {{1, 0xFF, 0x00}, {1, 0xFC, 0x00}}},
+    // probe at 9600, device at 4800 ... 115200
+    {{{2, 0xFE, 0x98}, {2, 0x66, 0x86}},
+     {{0, 0x00, 0x00}, {0, 0x00, 0x00}},
+     {{2, 0x2D, 0xCC}, {2, 0x71, 0x18}},
+     {{1, 0xA3, 0x00}, {2, 0x90, 0x2C}},
+     {{1, 0xE9, 0x00}, {2, 0x4A, 0xB7}},
+     {{1, 0xFC, 0x00}, {1, 0x9C, 0x00}}},
+    // probe at 19200, device at 4800 ... 115200
+    {{{2, 0xF8, 0x80}, {2, 0x78, 0x00}},
+     {{2, 0xFE, 0x98}, {2, 0x66, 0x86}},
+     {{0, 0x00, 0x00}, {0, 0x00, 0x00}},
+     {{2, 0x2D, 0xCC}, {2, 0x71, 0x18}},
+     {{2, 0x33, 0xFF}, {2, 0x88, 0x27}},
+     {{1, 0xE9, 0x00}, {2, 0x4A, 0xB7}}},
+    // probe at 38400, device at 4800 ... 115200
+    {{{2, 0x80, 0x00}, {2, 0x80, 0x80}},
+     {{2, 0xF8, 0x80}, {2, 0x78, 0x00}},
+     {{2, 0xFE, 0x98}, {2, 0x66, 0x86}},
+     {{0, 0x00, 0x00}, {0, 0x00, 0x00}},
+     {{2, 0xE3, 0x39}, {2, 0xA2, 0x6A}},
+     {{2, 0x33, 0xFF}, {2, 0x88, 0x27}}},
+    // probe at 57600, device at 4800 ... 115200
+    {{{2, 0x00, 0x00}, {2, 0x00, 0x00}},
+     {{2, 0xE0, 0x00}, {2, 0xE0, 0xE0}},
+     {{2, 0xFC, 0xE0}, {2, 0x1C, 0x00}},
+     {{2, 0x3E, 0x3B}, {2, 0x1A, 0x23}},
+     {{0, 0x00, 0x00}, {0, 0x00, 0x00}},
+     {{2, 0x0C, 0xCC}, {2, 0x73, 0x18}}},
+    // probe at 115200, device at 4800 ... 115200
+    {{{2, 0x00, 0x00}, {2, 0x00, 0x00}},
+     {{2, 0x00, 0x00}, {2, 0x00, 0x00}},
+     {{2, 0xE0, 0x00}, {2, 0xE0, 0xE0}},
+     {{2, 0xFC, 0xE0}, {2, 0x1C, 0x00}},
+     {{2, 0xFE, 0x98}, {2, 0x66, 0x86}},
+     {{0, 0x00, 0x00}, {0, 0x00, 0x00}}}
+};
+
 // response times for AT commands by firmware version
 const unsigned long responseMS[] = {FW1_RESPONSE, FW1_RESPONSE, FW2_RESPONSE};
 
@@ -96,7 +242,7 @@ const unsigned long responseMS[] = {FW1_RESPONSE, FW1_RESPONSE, FW2_RESPONSE};
 
 // string constants for HC-06 comman menu
 //  index 0 not used because parseInt will return 0 for non-numeric entries
-const String hc06Menu[] = { "", 
+const char hc06Menu[][50] PROGMEM = { "", 
                       ") Set HC06 Baud Rate",                             // 1
                       ") Set HC06 BT name",                               // 2
                       ") Set HC06 BT pin",                                // 3
@@ -120,7 +266,7 @@ const String hc06Menu[] = { "",
 #define MODE_DATA       LOW         // HC-05 in data mode
 #define MODE_COMMAND    HIGH        // HC-05 in command mode
 
-const String errorCodes[] = {
+const char errorCodes[][48] PROGMEM = {
                 "0 Command Error/Invalid Command",
                 "1 Results in default value",
                 "2 PSKEY write error",
@@ -151,5 +297,6 @@ const String errorCodes[] = {
                 "1B Invalid Security Mode entered",
                 "1C Invalid Encryption Mode entered"
 };
+#define ERROR_CODE_CNT  (sizeof(errorCodes) / sizeof(errorCodes[0]))
 
 #endif // CONSTANTS_H
@@ -0,0 +1,323 @@
+/**
+ * @file manageBT.cpp
+ *
+ * HC-05/06 AT Command Center
+ *
+ *  Description: Manager for several HC-05/06 modules, see manageBT.h.
+ */
+
+#include "configureBT.h"
+#include "manageBT.h"
+
+void HCManager::init() {
+  _count = 0;
+  _op = HC_OP_NONE;
+  _verbose = false;
+  _clock = &HCArduinoClock;
+  _jobs = NULL;
+  _jobCount = 0;
+  // sketch and library built with different HC_MANAGER_MAX disagree on 
+  //  position of arrays, so none may be accessed (see add())
+  if (_capacity != HC_MANAGER_MAX)  return;
+  for (int i = 0; i < HC_MANAGER_MAX; i++) {
+    _devices[i] = NULL;
+    _configs[i] = NULL;
+    _result[i] = HC_IDLE;
+    _phase[i] = HC_OP_NONE;
+    _job[i] = -1;
+  }
+  resetStats();
+}
+
+int HCManager::add(HCBT &device) {
+  if ((_capacity != HC_MANAGER_MAX) || (_count >= HC_MANAGER_MAX) || busy())
+    return -1;
+  _devices[_count] = &device;
+  _configs[_count] = NULL;
+  _result[_count] = HC_IDLE;
+  _phase[_count] = HC_OP_NONE;
+  return _count++;
+}
+
+int HCManager::count() {
+  return _count;
+}
+
+HCBT &HCManager::device(int index) {
+  if ((index < 0) || (index >= _count))   index = 0;
+  return *_devices[index];
+}
+
+bool HCManager::setConfig(int index, const HCConfig &config) {
+  if ((index < 0) || (index >= _count) || busy())  return false;
+  _configs[index] = &config;
+  return true;
+}
+
+void HCManager::setClock(HCClock *clock) {
+  _clock = (clock != NULL) ? clock : &HCArduinoClock;
+  for (int i = 0; i < _count; i++) {
+    _devices[i]->setClock(clock);
+  }
+}
+
+bool HCManager::detectAll(bool verboseOut) {
+  return (beginDetectAll(verboseOut) && waitAll());
+}
+
+bool HCManager::commitAll(bool verboseOut) {
+  return (beginCommitAll(verboseOut) && waitAll());
+}
+
+bool HCManager::provisionAll(bool verboseOut) {
+  return (beginProvisionAll(verboseOut) && waitAll());
+}
+
+bool HCManager::readAll(bool verboseOut) {
+  return (beginReadAll(verboseOut) && waitAll());
+}
+
+bool HCManager::beginDetectAll(bool verboseOut) {
+  return start(HC_OP_DETECT, verboseOut);
+}
+
+bool HCManager::beginCommitAll(bool verboseOut) {
+  return start(HC_OP_APPLY_CONFIG, verboseOut);
+}
+
+bool HCManager::beginProvisionAll(bool verboseOut) {
+  return start(HC_OP_PROVISION, verboseOut);
+}
+
+bool HCManager::beginReadAll(bool verboseOut) {
+  return start(HC_OP_READ_ALL, verboseOut);
+}
+
+bool HCManager::runJobs(HCJob *jobs, int count, bool verboseOut) {
+  return (beginJobs(jobs, count, verboseOut) && waitAll());
+}
+
+bool HCManager::beginJobs(HCJob *jobs, int count, bool verboseOut) {
+  if ((jobs == NULL) || (count <= 0) || busy())   return false;
+  for (int j = 0; j < count; j++) {
+    jobs[j].failedOp = HC_OP_NONE;
+    jobs[j].elapsed = 0;
+    // job for unregistered port is never started
+    jobs[j].status = ((jobs[j].port >= 0) && (jobs[j].port < _count)) ? 
+                      HC_IDLE : HC_FAILED;
+  }
+  _jobs = jobs;
+  _jobCount = count;
+  return start(HC_OP_RUN_JOBS, verboseOut);
+}
+
+const HCPortStats &HCManager::portStats(int index) {
+  static const HCPortStats none = HCPortStats();
+
+  if (_capacity != HC_MANAGER_MAX)  return none;
+  if ((index < 0) || (index >= _count))   index = 0;
+  return _stats[index];
+}
+
+void HCManager::resetStats() {
+  if (_capacity != HC_MANAGER_MAX)  return;
+  memset(_stats, 0, sizeof(_stats));
+}
+
+void HCManager::printStats() {
+  Serial.println("Port\tJobs\tFailed\tBusy ms\tDetect ms\tPer min");
+  for (int i = 0; i < _count; i++) {
+    Serial.print(i);
+    Serial.print("\t");
+    Serial.print(_stats[i].jobs);
+    Serial.print("\t");
+    Serial.print(_stats[i].failures);
+    Serial.print("\t");
+    Serial.print(_stats[i].busyMs);
+    Serial.print("\t");
+    Serial.print(_stats[i].detectMs);
+    Serial.print("\t");
+    // modules completed per minute of port activity
+    if (_stats[i].busyMs > 0) {
+      Serial.println((float)_stats[i].jobs * 60000.0 / _stats[i].busyMs);
+    } else {
+      Serial.println("-");
+    }
+  }
+}
+
+int HCManager::poll() {
+  bool failed = false;
+
+  if (_op == HC_OP_NONE)  return HC_IDLE;
+  // each busy device advances by one step per call, so no device waits on
+  //  another device's response
+  for (int i = 0; i < _count; i++) {
+    if (_result[i] == HC_BUSY) {
+      finishDevice(i, _devices[i]->poll());
+    }
+  }
+  for (int i = 0; i < _count; i++) {
+    if (_result[i] == HC_BUSY)    return HC_BUSY;
+    if (_result[i] == HC_FAILED)  failed = true;
+  }
+  if (_op == HC_OP_RUN_JOBS) {
+    // includes jobs for unregistered ports
+    for (int j = 0; j < _jobCount; j++) {
+      if (_jobs[j].status != HC_SUCCESS)  failed = true;
+    }
+  }
+  return (failed ? HC_FAILED : HC_SUCCESS);
+}
+
+bool HCManager::busy() {
+  for (int i = 0; i < _count; i++) {
+    if (_result[i] == HC_BUSY)    return true;
+  }
+  return false;
+}
+
+int HCManager::operation() {
+  return _op;
+}
+
+int HCManager::result(int index) {
+  if ((index < 0) || (index >= _count))   return HC_IDLE;
+  return _result[index];
+}
+
+bool HCManager::start(int op, bool verboseOut) {
+  if ((_capacity != HC_MANAGER_MAX) || (_count == 0) || busy())  return false;
+  for (int i = 0; i < _count; i++) {
+    // device may be busy with operation started by application
+    if (_devices[i]->busy())    return false;
+  }
+  _op = op;
+  _verbose = verboseOut;
+  for (int i = 0; i < _count; i++) {
+    _result[i] = HC_BUSY;
+    if (op == HC_OP_RUN_JOBS) {
+      // port without jobs to run completes at once, failed if none of its
+      //  jobs could be started
+      _job[i] = -1;
+      if (!nextJob(i))  _result[i] = jobsResult(i);
+    // provisioning detects every device before its configuration is written
+    } else if (!startDevice(i, (op == HC_OP_PROVISION) ? HC_OP_DETECT : op)) {
+      finishDevice(i, HC_FAILED);
+    }
+  }
+  return true;
+}
+
+bool HCManager::startDevice(int index, int op) {
+  HCBT *device = _devices[index];
+  const HCConfig *config;
+
+  _phase[index] = op;
+  if (_verbose) {
+    Serial.print("Device ");
+    Serial.print(index);
+    Serial.println(":");
+  }
+  switch (op) {
+    case HC_OP_DETECT:
+      return device->beginDetect(_verbose);
+    case HC_OP_APPLY_CONFIG:
+      config = (_op == HC_OP_RUN_JOBS) ? &_jobConfig[index] : 
+               (_op == HC_OP_PROVISION) ? _configs[index] : NULL;
+      // settings left staged by an earlier failed commit are not written 
+      //  together with configuration of provisioning
+      if ((config != NULL) && (_op == HC_OP_PROVISION))   device->clearStaged();
+      // configuration is validated against model and firmware once detected
+      if ((config != NULL) && !device->stageConfig(*config))  return false;
+      return device->beginCommit(_verbose);
+    case HC_OP_READ_ALL:
+      return device->beginReadAll(_verbose);
+    default:
+      return false;
+  }
+}
+
+void HCManager::finishDevice(int index, int status) {
+  if (status == HC_BUSY)  return;
+  if ((status == HC_SUCCESS) && (_phase[index] == HC_OP_DETECT) &&
+        ((_op == HC_OP_PROVISION) || (_op == HC_OP_RUN_JOBS))) {
+    // commit proceeds while other devices are still being detected
+    _commitStart[index] = _clock->millis();
+    if (startDevice(index, HC_OP_APPLY_CONFIG))   return;
+    status = HC_FAILED;
+  }
+  if (_op == HC_OP_RUN_JOBS) {
+    finishJob(index, status);
+    // port continues with its next job, and has failed if any of its jobs did
+    if (nextJob(index))   return;
+    status = jobsResult(index);
+  }
+  _result[index] = status;
+  if (_verbose) {
+    Serial.print("Device ");
+    Serial.print(index);
+    Serial.println((status == HC_SUCCESS) ? ": done" : ": failed");
+  }
+}
+
+int HCManager::jobsResult(int index) {
+  for (int j = 0; j < _jobCount; j++) {
+    if ((_jobs[j].port == index) && (_jobs[j].status == HC_FAILED))
+      return HC_FAILED;
+  }
+  return HC_SUCCESS;
+}
+
+bool HCManager::nextJob(int index) {
+  for (int j = _job[index] + 1; j < _jobCount; j++) {
+    if ((_jobs[j].port != index) || (_jobs[j].status != HC_IDLE))  continue;
+    _job[index] = j;
+    _jobs[j].status = HC_BUSY;
+    _jobConfig[index] = HCConfig();
+    if (_jobs[j].name != NULL)  _jobConfig[index].name = _jobs[j].name;
+    if (_jobs[j].pin != NULL)   _jobConfig[index].pin = _jobs[j].pin;
+    _jobConfig[index].role = _jobs[j].role;
+    _jobConfig[index].baud = _jobs[j].baud;
+    _jobConfig[index].parity = _jobs[j].parity;
+    _jobStart[index] = _clock->millis();
+    // settings of a failed job remain staged, and must not be written to
+    //  module of this job
+    _devices[index]->clearStaged();
+    // module of each job is detected, since it may differ from previous job
+    if (startDevice(index, HC_OP_DETECT))   return true;
+    finishJob(index, HC_FAILED);
+  }
+  return false;
+}
+
+void HCManager::finishJob(int index, int status) {
+  HCJob &job = _jobs[_job[index]];
+  unsigned long now = _clock->millis();
+
+  job.status = status;
+  job.elapsed = now - _jobStart[index];
+  if (status != HC_SUCCESS)   job.failedOp = _phase[index];
+  _stats[index].jobs++;
+  if (status != HC_SUCCESS)   _stats[index].failures++;
+  _stats[index].busyMs += job.elapsed;
+  _stats[index].detectMs += ((_phase[index] == HC_OP_DETECT) ? now : 
+                              _commitStart[index]) - _jobStart[index];
+  if (_verbose) {
+    Serial.print("Port ");
+    Serial.print(index);
+    Serial.print(", job ");
+    Serial.print(_job[index]);
+    Serial.print((status == HC_SUCCESS) ? ": done (ms) " : ": failed (ms) ");
+    Serial.println(job.elapsed);
+  }
+}
+
+bool HCManager::waitAll() {
+  int status;
+
+  while ((status = poll()) == HC_BUSY) {
+    _clock->idle();
+  }
+  return (status == HC_SUCCESS);
+}
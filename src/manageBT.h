@@ -0,0 +1,373 @@
+/**
+ * @file manageBT.h
+ *
+ * HC-05/06 AT Command Center
+ *
+ *  Description: Manager for several HC-05/06 modules, each connected to its
+ *              own UART (e.g. Serial1-Serial3 of Mega, or USB-UART adapters
+ *              of a Linux host) and KEY/STATE pins. HCManager starts the same
+ *              operation on every registered HCBT and polls their state
+ *              machines in turn, so modules wait for responses concurrently 
+ *              and the batch completes in about the time of the slowest 
+ *              module, rather than the sum of all. A list of provisioning 
+ *              jobs may be run across all ports in the same way.
+ */
+
+#ifndef MANAGEBT_H
+#define MANAGEBT_H
+
+#include <Arduino.h>
+#include "configureBT.h"
+
+/** maximum count of devices registered with HCManager. May be set larger for
+ *  host builds driving a tray of modules, but only as a build flag (e.g.
+ *  -DHC_MANAGER_MAX=8, or EXTRA_CXXFLAGS of EpoxyDuino), since the size of 
+ *  HCManager must match in every file including this header. Defining it in
+ *  a sketch before #include changes the sketch's HCManager but not the one
+ *  compiled with the library. */
+#ifndef HC_MANAGER_MAX
+  #define HC_MANAGER_MAX      4
+#endif
+
+/**
+ * HCJob struct
+ * 
+ * Provisioning job of HCManager::runJobs(): configuration written to module
+ * on one port, and result filled in when job completes. Jobs of a port run
+ * in list order, while ports run concurrently.
+ */
+struct HCJob {
+  /** index of device (port) returned by HCManager::add() */
+  int port;
+  /** Bluetooth name (NULL or empty - not modified) */
+  const char *name;
+  /** Bluetooth pin/passkey (NULL or empty - not modified) */
+  const char *pin;
+  /** role of HC-05 device (ROLE_UNKNOWN - not modified) */
+  int role;
+  /** UART baud rate, e.g. 9600 (0 - not modified) */
+  unsigned long baud;
+  /** UART parity: 0 - NOPARITY, 1 - ODDPARITY, 2 - EVENPARITY (-1 - not modified) */
+  int parity;
+  /** result: HC_IDLE (not started), HC_BUSY, HC_SUCCESS or HC_FAILED */
+  int status;
+  /** operation which failed: HC_OP_DETECT, HC_OP_APPLY_CONFIG (including 
+   *  settings not valid for module), or HC_OP_NONE (invalid port) */
+  int failedOp;
+  /** duration of job (ms) */
+  unsigned long elapsed;
+
+  HCJob(int port = 0, const char *name = NULL, const char *pin = NULL,
+        int role = ROLE_UNKNOWN, unsigned long baud = 0, int parity = -1) :
+        port(port), name(name), pin(pin), role(role), baud(baud), 
+        parity(parity), status(HC_IDLE), failedOp(HC_OP_NONE), elapsed(0) {}
+};
+
+/**
+ * HCPortStats struct
+ * 
+ * Provisioning statistics of one port, accumulated over runJobs() calls 
+ * until resetStats().
+ */
+struct HCPortStats {
+  /** count of jobs completed (succeeded or failed) */
+  unsigned int jobs;
+  /** count of failed jobs */
+  unsigned int failures;
+  /** total duration of jobs (ms) */
+  unsigned long busyMs;
+  /** part of busyMs spent detecting modules (ms) */
+  unsigned long detectMs;
+};
+
+class HCManager
+{
+public:
+  /**
+   * @brief Constructor for manager without devices.
+   * 
+   * Defined in this header, so that capacity (HC_MANAGER_MAX) seen by the 
+   * sketch is stored in the object and compared with that of the library.
+   */
+  HCManager() : _capacity(HC_MANAGER_MAX) { init(); }
+
+  /**
+   * @brief Register device with manager. Device must remain in scope while
+   *        registered, and each device must use a separate UART.
+   *
+   * @param device      HCBT instance, e.g. declared as HCBT hc2(Serial2, 22, 23)
+   *
+   * @returns index of device, or -1 if HC_MANAGER_MAX devices registered, or
+   *          if HC_MANAGER_MAX of sketch differs from library build
+   */
+  int add(HCBT &device);
+
+  /** @returns count of registered devices */
+  int count();
+
+  /**
+   * @brief Returns registered device, e.g. for stageConfig() or snapshot().
+   *
+   * @param index       index returned by add()
+   */
+  HCBT &device(int index);
+
+  /**
+   * @brief Set configuration written to device by provisionAll(). Config
+   *        must remain in scope until provisioning completes.
+   *
+   * @param index       index returned by add()
+   * @param config      desired configuration of device (see HCConfig)
+   *
+   * @returns true if index is valid
+   */
+  bool setConfig(int index, const HCConfig &config);
+
+  /**
+   * @brief Set time source of manager and of every registered device. Call
+   *        while no operation is busy.
+   *
+   * @param clock       time source, or NULL for HCArduinoClock (default)
+   */
+  void setClock(HCClock *clock);
+
+  /**
+   * @brief Detect every registered device concurrently. Blocks until all
+   *        have completed.
+   *
+   * @param verboseOut  print details of each device to Serial
+   *
+   * @returns true if every device was detected
+   */
+  bool detectAll(bool verboseOut = false);
+
+  /**
+   * @brief Write staged configuration (see HCBT::stageConfig()) of every
+   *        registered device concurrently. Devices must have been detected.
+   *
+   * @param verboseOut  print details of each device to Serial
+   *
+   * @returns true if every device was configured
+   */
+  bool commitAll(bool verboseOut = false);
+
+  /**
+   * @brief Detect every registered device, then write its configuration 
+   *        (see setConfig()) as soon as it has been detected, without waiting
+   *        for other devices. Only settings which differ are written, and
+   *        settings staged previously are discarded (see HCBT::clearStaged()).
+   *
+   * @param verboseOut  print details of each device to Serial
+   *
+   * @returns true if every device was detected and configured
+   */
+  bool provisionAll(bool verboseOut = false);
+
+  /**
+   * @brief Read properties of every registered device concurrently (see
+   *        HCBT::readAll()). Devices must have been detected.
+   *
+   * @param verboseOut  print details of each device to Serial
+   *
+   * @returns true if properties of every device were read
+   */
+  bool readAll(bool verboseOut = false);
+
+  /**
+   * @brief Start detectAll() without blocking; call poll() until complete.
+   *
+   * @returns true if operation was started
+   */
+  bool beginDetectAll(bool verboseOut = false);
+
+  /**
+   * @brief Start commitAll() without blocking; call poll() until complete.
+   *
+   * @returns true if operation was started
+   */
+  bool beginCommitAll(bool verboseOut = false);
+
+  /**
+   * @brief Start provisionAll() without blocking; call poll() until complete.
+   *
+   * @returns true if operation was started
+   */
+  bool beginProvisionAll(bool verboseOut = false);
+
+  /**
+   * @brief Start readAll() without blocking; call poll() until complete.
+   *
+   * @returns true if operation was started
+   */
+  bool beginReadAll(bool verboseOut = false);
+
+  /**
+   * @brief Run list of provisioning jobs: each port detects its module and
+   *        writes the settings of its next job, then continues with its 
+   *        following job, without waiting for other ports. Blocks until all
+   *        jobs have completed; result of each is written to its HCJob.
+   *
+   * @param jobs        list of jobs, must remain in scope until complete
+   * @param count       count of jobs in list
+   * @param verboseOut  print result of each job to Serial
+   *
+   * @returns true if every job succeeded
+   */
+  bool runJobs(HCJob *jobs, int count, bool verboseOut = false);
+
+  /**
+   * @brief Start runJobs() without blocking; call poll() until complete.
+   *
+   * @returns true if operation was started
+   */
+  bool beginJobs(HCJob *jobs, int count, bool verboseOut = false);
+
+  /**
+   * @brief Returns provisioning statistics of one port.
+   *
+   * @param index       index returned by add()
+   */
+  const HCPortStats &portStats(int index);
+
+  /**
+   * @brief Clear provisioning statistics of every port.
+   */
+  void resetStats();
+
+  /**
+   * @brief Print jobs, failures, busy and detection time, and throughput
+   *        (modules per minute) of each port to Serial.
+   */
+  void printStats();
+
+  /**
+   * @brief Advance operation of every busy device once. Call repeatedly from
+   *        loop().
+   *
+   * @returns status of current or last operation:
+   *    - HC_IDLE     - no operation started
+   *    - HC_BUSY     - operation in progress on at least one device
+   *    - HC_SUCCESS  - operation succeeded on every device
+   *    - HC_FAILED   - operation failed on at least one device
+   */
+  int poll();
+
+  /**
+   * @brief Returns true while operation is in progress on any device.
+   */
+  bool busy();
+
+  /**
+   * @brief Returns identifier of current or last operation (HC_OP_xxx).
+   */
+  int operation();
+
+  /**
+   * @brief Returns status of last operation for one device (HC_IDLE,
+   *        HC_BUSY, HC_SUCCESS or HC_FAILED).
+   *
+   * @param index       index returned by add()
+   */
+  int result(int index);
+
+private:
+  /**
+   * init
+   *
+   * @brief Initialize manager without devices. Arrays are left untouched if
+   *        capacity of object differs from library build, so that manager 
+   *        accepts no devices.
+   */
+  void init();
+
+  /**
+   * start
+   *
+   * @brief Start operation on every registered device. Devices on which
+   *        operation cannot be started are marked as failed.
+   *
+   * @returns true if operation was started
+   */
+  bool start(int op, bool verboseOut);
+
+  /**
+   * startDevice
+   *
+   * @brief Start operation (or phase of provisioning) on one device.
+   *
+   * @returns true if operation was started
+   */
+  bool startDevice(int index, int op);
+
+  /**
+   * finishDevice
+   *
+   * @brief Record completion of operation on one device, staging and
+   *        committing configuration once a device being provisioned has
+   *        been detected.
+   */
+  void finishDevice(int index, int status);
+
+  /**
+   * jobsResult
+   *
+   * @brief Result of port once it has no job left to run.
+   *
+   * @returns HC_FAILED if any job of port failed, otherwise HC_SUCCESS
+   */
+  int jobsResult(int index);
+
+  /**
+   * waitAll
+   *
+   * @brief Poll devices until operation completes.
+   *
+   * @returns true if operation succeeded on every device
+   */
+  bool waitAll();
+
+  /**
+   * nextJob
+   *
+   * @brief Start next pending job of port, if any.
+   *
+   * @returns true if a job was started
+   */
+  bool nextJob(int index);
+
+  /**
+   * finishJob
+   *
+   * @brief Record result of current job of port in job and port statistics.
+   */
+  void finishJob(int index, int status);
+
+  // HC_MANAGER_MAX seen by code which constructed object. Members up to the 
+  //  arrays have the same layout whatever the capacity, so they may be used 
+  //  before capacity is checked.
+  int _capacity;
+  int _count;
+  // current or last operation
+  int _op;
+  bool _verbose;
+  HCClock *_clock;
+  // job list of runJobs()
+  HCJob *_jobs;
+  int _jobCount;
+  HCBT *_devices[HC_MANAGER_MAX];
+  // configuration written by provisionAll() (NULL - none)
+  const HCConfig *_configs[HC_MANAGER_MAX];
+  // status of each device
+  int _result[HC_MANAGER_MAX];
+  // operation in progress on each device (detect or commit while provisioning)
+  int _phase[HC_MANAGER_MAX];
+  // current job of each port (-1 - none), and configuration written by it
+  int _job[HC_MANAGER_MAX];
+  HCConfig _jobConfig[HC_MANAGER_MAX];
+  // start of current job and of its commit phase (ms)
+  unsigned long _jobStart[HC_MANAGER_MAX];
+  unsigned long _commitStart[HC_MANAGER_MAX];
+  HCPortStats _stats[HC_MANAGER_MAX];
+};
+
+#endif // MANAGEBT_H
@@ -0,0 +1,459 @@
+/**
+ * @file simulateBT.cpp
+ *
+ * HC-05/06 AT Command Center
+ *
+ *  Description: Simulated HC-05/06 module, see simulateBT.h.
+ */
+
+#ifdef HC_SIMULATOR
+
+#include "configureBT.h"
+#include "simulateBT.h"
+
+HCSimulator HCSim;
+
+// level of bit k of UART frames sent for length characters of text (line is
+//  idle before and after)
+static int frameBit(const char *text, int length, long k, int bits, int parity) {
+  if ((k < 0) || (k >= (long)length * bits))  return 1;
+  unsigned char frame = text[k / bits];
+  int pos = k % bits;
+
+  if (pos == 0)  return 0;                          // start bit
+  if (pos <= 8)  return (frame >> (pos - 1)) & 1;   // data bits, LSB first
+  if ((pos == 9) && (parity != NOPARITY)) {
+    int ones = 0;
+    for (int i = 0; i < 8; i++)  ones += (frame >> i) & 1;
+    return (parity == EVENPARITY) ? (ones & 1) : !(ones & 1);
+  }
+  return 1;                                         // stop bit
+}
+
+HCSimulator::HCSimulator() {
+  _clock = &HCArduinoClock;
+  _open = false;
+  _hostBaud = 0;
+  _hostConfig = SERIAL_8N1;
+  _rxHead = 0;
+  _rxCount = 0;
+  _txFree = 0;
+  setDevice(MODEL_HC05, FIRM_VERSION2);
+  setUART(38400, NOPARITY);
+  setMismatch(HC_SIM_SILENT, HC_SIM_SILENT);
+  resetCounters();
+}
+
+void HCSimulator::setDevice(int model, int firmware) {
+  _firmware = (firmware == FIRM_VERSION1) ? FIRM_VERSION1 : FIRM_VERSION2;
+  // firmware 1.x is only found on HC-06 modules
+  _model = ((model == MODEL_HC05) && (_firmware == FIRM_VERSION2)) ? MODEL_HC05
+                                                                    : MODEL_HC06;
+  _role = ROLE_SECONDARY;
+  strcpy(_name, (_model == MODEL_HC05) ? "HC-05" : "HC-06");
+  strcpy(_pin, "1234");
+  _cmdLength = 0;
+  _cmdGarbled = false;
+  _command[0] = '\0';
+}
+
+void HCSimulator::setUART(unsigned long baud, int parity) {
+  _baud = baud;
+  _parity = _pendingParity = parity;
+}
+
+void HCSimulator::setClock(HCClock *clock) {
+  _clock = (clock != NULL) ? clock : &HCArduinoClock;
+}
+
+void HCSimulator::setMismatch(int baudMode, int parityMode) {
+  _baudMode = baudMode;
+  _parityMode = parityMode;
+}
+
+void HCSimulator::powerCycle() {
+  _parity = _pendingParity;
+  _cmdLength = 0;
+  _cmdGarbled = false;
+  _command[0] = '\0';
+  _rxCount = 0;
+  _txFree = _clock->millis();
+}
+
+unsigned long HCSimulator::baud() {
+  return _baud;
+}
+
+int HCSimulator::parity() {
+  return _parity;
+}
+
+int HCSimulator::role() {
+  return _role;
+}
+
+const char *HCSimulator::name() {
+  return _name;
+}
+
+const char *HCSimulator::pin() {
+  return _pin;
+}
+
+unsigned long HCSimulator::commands() {
+  return _commands;
+}
+
+unsigned long HCSimulator::flashWrites() {
+  return _flashWrites;
+}
+
+unsigned long HCSimulator::bytesWritten() {
+  return _bytesWritten;
+}
+
+unsigned long HCSimulator::uartBegins() {
+  return _begins;
+}
+
+unsigned long HCSimulator::uartEnds() {
+  return _ends;
+}
+
+void HCSimulator::resetCounters() {
+  _commands = 0;
+  _flashWrites = 0;
+  _bytesWritten = 0;
+  _begins = 0;
+  _ends = 0;
+}
+
+void HCSimulator::begin(unsigned long baud, uint32_t config) {
+  _open = true;
+  _hostBaud = baud;
+  _hostConfig = config;
+  _rxCount = 0;
+  _begins++;
+}
+
+void HCSimulator::end() {
+  _open = false;
+  _ends++;
+}
+
+int HCSimulator::available() {
+  int count = 0;
+
+  update();
+  while ((count < _rxCount) &&
+          ((long)(_clock->millis() - _rxDue[(_rxHead + count) % HC_SIM_BUFFER]) >= 0)) {
+    count++;
+  }
+  return count;
+}
+
+int HCSimulator::read() {
+  char inChar;
+
+  if (available() < 1)  return -1;
+  inChar = _rxChars[_rxHead];
+  _rxHead = (_rxHead + 1) % HC_SIM_BUFFER;
+  _rxCount--;
+  return (unsigned char)inChar;
+}
+
+int HCSimulator::peek() {
+  if (available() < 1)  return -1;
+  return (unsigned char)_rxChars[_rxHead];
+}
+
+void HCSimulator::flush() {
+}
+
+size_t HCSimulator::write(uint8_t c) {
+  _bytesWritten++;
+  if (_open) {
+    update();
+    receive((char)c);
+  }
+  return 1;
+}
+
+void HCSimulator::update() {
+  // firmware 1.x executes command once UART has been idle
+  if ((_firmware == FIRM_VERSION1) && (_cmdLength > 0) &&
+        ((_clock->millis() - _lastRx) >= FW1_CMD_IDLE)) {
+    execute();
+  }
+}
+
+void HCSimulator::receive(char inChar) {
+  bool parityMatch = (hostParity() == _parity) || (_parityMode == HC_SIM_ACCEPT);
+
+  if ((_hostBaud != _baud) || !parityMatch) {
+    if (((_hostBaud != _baud) ? _baudMode : _parityMode) == HC_SIM_SILENT)  return;
+    // garbled command, line ending is still recognized
+    _cmdGarbled = true;
+  }
+  _lastRx = _clock->millis();
+  if (_cmdLength < (HC_SIM_BUFFER - 1)) {
+    _command[_cmdLength++] = inChar;
+    _command[_cmdLength] = '\0';
+  }
+  if ((_firmware == FIRM_VERSION2) && (inChar == '\n')) {
+    execute();
+  }
+}
+
+void HCSimulator::execute() {
+  if (_firmware == FIRM_VERSION2) {
+    // remove line ending, empty line is ignored
+    while ((_cmdLength > 0) && ((_command[_cmdLength - 1] == '\n') ||
+                                (_command[_cmdLength - 1] == '\r'))) {
+      _command[--_cmdLength] = '\0';
+    }
+  }
+  if (_cmdLength > 0) {
+    _commands++;
+    if (!_cmdGarbled) {
+      if (_firmware == FIRM_VERSION2)  executeV2();
+      else                             executeV1();
+    } else if (_firmware == FIRM_VERSION2) {
+      reply("ERROR:(0)\r\n");
+    }
+  }
+  _cmdLength = 0;
+  _cmdGarbled = false;
+  _command[0] = '\0';
+}
+
+void HCSimulator::executeV1() {
+  char text[HC_SIM_BUFFER];
+  const char *arg;
+
+  if (strcmp(_command, "AT") == 0) {
+    reply("OK");
+  } else if (strcmp(_command, "AT+VERSION") == 0) {
+    reply("OKlinvorV1.8");
+  } else if (strncmp(_command, "AT+NAME", 7) == 0) {
+    arg = _command + 7;
+    strncpy(_name, arg, HC_NAME_MAX);
+    _name[HC_NAME_MAX] = '\0';
+    _flashWrites++;
+    reply("OKsetname");
+  } else if (strncmp(_command, "AT+PIN", 6) == 0) {
+    arg = _command + 6;
+    strncpy(_pin, arg, HC_PIN_MAX);
+    _pin[HC_PIN_MAX] = '\0';
+    _flashWrites++;
+    reply("OKsetPIN");
+  } else if ((strncmp(_command, "AT+BAUD", 7) == 0) && (_cmdLength == 8) &&
+              (_command[7] >= '1') && (_command[7] < '1' + BAUD_LIST_CNT)) {
+    // reply is sent at previous baud rate
+    snprintf(text, sizeof(text), "OK%lu", baudRateList[_command[7] - '1']);
+    reply(text);
+    _baud = baudRateList[_command[7] - '1'];
+    _flashWrites++;
+  } else if (strcmp(_command, "AT+PN") == 0) {
+    _pendingParity = NOPARITY;
+    _flashWrites++;
+    reply("OK None");
+  } else if (strcmp(_command, "AT+PO") == 0) {
+    _pendingParity = ODDPARITY;
+    _flashWrites++;
+    reply("OK setodd");
+  } else if (strcmp(_command, "AT+PE") == 0) {
+    _pendingParity = EVENPARITY;
+    _flashWrites++;
+    reply("OK seteven");
+  }
+  // firmware 1.x does not reply to unknown commands
+}
+
+void HCSimulator::executeV2() {
+  char text[HC_SIM_BUFFER];
+  const char *arg = strchr(_command, '=');
+  unsigned long baud;
+  int stop, parity, length;
+  int baudIndex = -1;
+
+  if (arg != NULL)  arg++;
+  text[0] = '\0';
+  if (strcmp(_command, "AT") == 0) {
+    // status only
+  } else if (strcmp(_command, "AT+VERSION?") == 0) {
+    strcpy(text, (_model == MODEL_HC05) ? "+VERSION:3.0-20170601\r\n"
+                                        : "hc01.comV2.0\r\n");
+  } else if (strcmp(_command, "AT+NAME?") == 0) {
+    snprintf(text, sizeof(text), "+NAME:%s\r\n", _name);
+  } else if (strncmp(_command, "AT+NAME=", 8) == 0) {
+    if (strlen(arg) == 0) {
+      reply("ERROR:(4)\r\n");
+      return;
+    }
+    if (strlen(arg) > 32) {
+      reply("ERROR:(3)\r\n");
+      return;
+    }
+    strncpy(_name, arg, HC_NAME_MAX);
+    _name[HC_NAME_MAX] = '\0';
+    _flashWrites++;
+  } else if ((strcmp(_command, "AT+PSWD?") == 0) && (_model == MODEL_HC05)) {
+    // firmware 3.x replies with quoted passkey, as +PIN
+    snprintf(text, sizeof(text), "+PIN:\"%s\"\r\n", _pin);
+  } else if (strncmp(_command, "AT+PSWD=", 8) == 0) {
+    // passkey may be quoted (firmware 3.x)
+    if (*arg == '"')  arg++;
+    length = strlen(arg);
+    if ((length > 0) && (arg[length - 1] == '"'))  length--;
+    if (length == 0) {
+      reply("ERROR:(F)\r\n");
+      return;
+    }
+    if (length > 16) {
+      reply("ERROR:(10)\r\n");
+      return;
+    }
+    if (length > HC_PIN_MAX)  length = HC_PIN_MAX;
+    strncpy(_pin, arg, length);
+    _pin[length] = '\0';
+    _flashWrites++;
+  } else if (strcmp(_command, "AT+ROLE?") == 0) {
+    snprintf(text, sizeof(text), "+ROLE:%d\r\n", _role);
+  } else if ((strncmp(_command, "AT+ROLE=", 8) == 0) && (_model == MODEL_HC05)) {
+    if ((strlen(arg) != 1) || (*arg < '0') || (*arg > '2')) {
+      reply("ERROR:(11)\r\n");
+      return;
+    }
+    _role = *arg - '0';
+    _flashWrites++;
+  } else if ((strcmp(_command, "AT+ADDR?") == 0) && (_model == MODEL_HC05)) {
+    strcpy(text, "+ADDR:98d3:31:fb1234\r\n");
+  } else if ((strcmp(_command, "AT+CLASS?") == 0) && (_model == MODEL_HC05)) {
+    strcpy(text, "+CLASS:1f00\r\n");
+  } else if ((strcmp(_command, "AT+CMODE?") == 0) && (_model == MODEL_HC05)) {
+    // key of reply is truncated by firmware
+    strcpy(text, "+CMOD:1\r\n");
+  } else if ((strcmp(_command, "AT+BIND?") == 0) && (_model == MODEL_HC05)) {
+    strcpy(text, "+BIND:0:0:0\r\n");
+  } else if (strcmp(_command, "AT+UART?") == 0) {
+    snprintf(text, sizeof(text), "+UART:%lu,0,%d\r\n", _baud, _parity);
+  } else if (strncmp(_command, "AT+UART=", 8) == 0) {
+    baud = strtoul(arg, (char **)&arg, 10);
+    stop = (*arg == ',') ? (int)strtol(arg + 1, (char **)&arg, 10) : -1;
+    parity = (*arg == ',') ? (int)strtol(arg + 1, (char **)&arg, 10) : -1;
+    for (int i = VERS2_MIN_BAUD; i < BAUD_LIST_CNT; i++) {
+      if (baud == baudRateList[i])  baudIndex = i;
+    }
+    if (baudIndex < 0) {
+      reply("ERROR:(12)\r\n");
+    } else if ((stop != STOP1BIT) && (stop != STOP2BIT)) {
+      reply("ERROR:(13)\r\n");
+    } else if ((parity < NOPARITY) || (parity > EVENPARITY)) {
+      reply("ERROR:(14)\r\n");
+    } else {
+      // reply is sent with previous settings
+      reply("OK\r\n");
+      _baud = baud;
+      _parity = _pendingParity = parity;
+      _flashWrites++;
+    }
+    return;
+  } else {
+    reply("ERROR:(0)\r\n");
+    return;
+  }
+  strcat(text, "OK\r\n");
+  reply(text);
+}
+
+void HCSimulator::reply(const char *text) {
+  char received[HC_SIM_BUFFER];
+  int length = strlen(text);
+  int count = 0;
+  int hostBits = frameBits(hostParity());
+  unsigned long start, duration;
+
+  if (_hostBaud != _baud) {
+    // characters are mis-framed by Serial1
+    count = misframe(text, received, HC_SIM_BUFFER);
+  } else {
+    for (int i = 0; i < length; i++) {
+      // Serial1 drops characters failing its parity check, where module sends
+      //  parity bit of its own setting (or stop bit)
+      if ((hostBits > 10) && (_parity != hostParity()) &&
+            (frameBit(text + i, 1, 9, frameBits(_parity), _parity) !=
+             frameBit(text + i, 1, 9, hostBits, hostParity())))
+        continue;
+      received[count++] = text[i];
+    }
+  }
+  // firmware 1.x executes command once idle, firmware 2.x/3.x after latency
+  start = (_firmware == FIRM_VERSION1) ? (_lastRx + FW1_CMD_IDLE)
+                                       : (_clock->millis() + HC_SIM_LATENCY);
+  if ((long)(_txFree - start) > 0)  start = _txFree;
+  duration = (length * frameBits(_parity) * 1000UL + _baud - 1) / _baud;
+  for (int i = 0; i < count; i++) {
+    queueChar(received[i], start + (duration * (i + 1)) / count);
+  }
+  _txFree = start + duration;
+}
+
+void HCSimulator::queueChar(char inChar, unsigned long due) {
+  // characters beyond capacity of receive buffer are lost
+  if (_rxCount >= HC_SIM_BUFFER)  return;
+  _rxChars[(_rxHead + _rxCount) % HC_SIM_BUFFER] = inChar;
+  _rxDue[(_rxHead + _rxCount) % HC_SIM_BUFFER] = due;
+  _rxCount++;
+}
+
+int HCSimulator::misframe(const char *text, char *output, int maxChars) {
+  int length = strlen(text);
+  int bits = frameBits(_parity);
+  int hostBits = frameBits(hostParity());
+  long total = length * (long)bits;
+  double moduleBit = 1.0 / _baud;
+  double hostBit = 1.0 / _hostBaud;
+  double ready = 0, start;
+  long k;
+  int count = 0, value;
+
+  while (count < maxChars) {
+    // start bit is found from next falling edge once Serial1 is ready
+    k = (long)ceil(ready / moduleBit - 1e-9);
+    while ((k < total) && !((frameBit(text, length, k - 1, bits, _parity) == 1) &&
+                            (frameBit(text, length, k, bits, _parity) == 0))) {
+      k++;
+    }
+    if (k >= total)  break;
+    start = k * moduleBit;
+    if (frameBit(text, length, (long)((start + 0.5 * hostBit) / moduleBit), 
+                  bits, _parity) != 0) {
+      // start bit too short to be sampled
+      ready = start + moduleBit;
+      continue;
+    }
+    value = 0;
+    for (int i = 0; i < 8; i++) {
+      value |= frameBit(text, length, (long)((start + (1.5 + i) * hostBit) / moduleBit),
+                        bits, _parity) << i;
+    }
+    output[count++] = (char)value;
+    // ready for next start bit once stop bit is sampled
+    ready = start + (hostBits - 0.5) * hostBit;
+  }
+  return count;
+}
+
+int HCSimulator::frameBits(int parity) {
+  return (parity == NOPARITY) ? 10 : 11;
+}
+
+int HCSimulator::hostParity() {
+  for (int i = 0; i < PARITY_LIST_CNT; i++) {
+    if (_hostConfig == parityList[i])  return i;
+  }
+  return NOPARITY;
+}
+
+#endif // HC_SIMULATOR
@@ -0,0 +1,238 @@
+/**
+ * @file simulateBT.h
+ *
+ * HC-05/06 AT Command Center
+ *
+ *  Description: Simulated HC-05/06 module, for exercising HCBT without hardware
+ *              (e.g. host builds with an Arduino API emulation such as
+ *              EpoxyDuino). HCSimulator implements the Stream and begin()/end()
+ *              interface of Serial1, and responds as the selected module would:
+ *
+ *                Firmware 1.x (HC-06) - commands without line ending, executed
+ *                  once UART has been idle for ~500 ms, replies not terminated
+ *                  (AT, AT+VERSION, AT+NAMEx, AT+PINx, AT+BAUDn, AT+PN/PO/PE)
+ *                Firmware 2.x/3.x (HC-05/HC-06) - commands terminated by CRLF,
+ *                  replies +KEY:value lines followed by OK or ERROR:(x) status
+ *                  (AT, AT+VERSION?, AT+NAME, AT+PSWD, AT+ROLE, AT+ADDR?,
+ *                  AT+UART, and queries AT+CLASS?, AT+CMODE?, AT+BIND?)
+ *
+ *              Replies arrive paced at the character rate of the module UART.
+ *              Behavior for mismatched baud rate or parity of Serial1 is
+ *              selected with setMismatch().
+ *
+ *              Build with HC_SIMULATOR defined to connect HCBT to global
+ *              simulator HCSim in place of Serial1. HCSimulator is only
+ *              compiled in such builds, so it adds nothing to board builds.
+ */
+
+#ifndef SIMULATEBT_H
+#define SIMULATEBT_H
+
+#ifndef HC_SIMULATOR
+  #error "simulateBT.h requires host build with HC_SIMULATOR defined"
+#endif
+
+#include <Arduino.h>
+#include "configureBT.h"
+#include "includes/constants.h"
+
+/** module ignores characters received with mismatched UART settings */
+#define HC_SIM_SILENT         0
+/** module answers garbled command with ERROR status, received garbled */
+#define HC_SIM_GARBLED        1
+/** module ignores parity mismatch (parity not checked by either UART) */
+#define HC_SIM_ACCEPT         2
+
+/** capacity of simulated module buffers (command, and reply not yet read by 
+ *  Serial1, which holds replies to a pipelined burst) */
+#define HC_SIM_BUFFER         128
+/** delay before firmware 2.x/3.x module replies to command (ms) */
+#define HC_SIM_LATENCY        15
+
+class HCSimulator : public Stream
+{
+public:
+  /**
+   * @brief Constructor for simulated HC-05 (firmware 3.x) at 38400 8N1.
+   */
+  HCSimulator();
+
+  /**
+   * @brief Select simulated module. Resets name, pin and role to defaults.
+   *
+   * @param model       MODEL_HC05 or MODEL_HC06
+   * @param firmware    FIRM_VERSION1 (HC-06 only) or FIRM_VERSION2
+   */
+  void setDevice(int model, int firmware);
+
+  /**
+   * @brief Set UART configuration of simulated module.
+   *
+   * @param baud        baud rate of module UART (e.g. 9600)
+   * @param parity      parity of module UART (0 - None, 1 - Odd, 2 - Even)
+   */
+  void setUART(unsigned long baud, int parity);
+
+  /**
+   * @brief Select behavior when Serial1 settings do not match module UART.
+   *
+   * @param baudMode    HC_SIM_SILENT, or HC_SIM_GARBLED (fw 2.x/3.x answers
+   *                    ERROR, received mis-framed at Serial1 baud rate)
+   * @param parityMode  HC_SIM_SILENT, HC_SIM_GARBLED (fw 2.x/3.x answers
+   *                    ERROR, characters failing parity check are dropped),
+   *                    or HC_SIM_ACCEPT
+   */
+  void setMismatch(int baudMode, int parityMode);
+
+  /**
+   * @brief Set time source of simulated module, normally same as HCBT.
+   *
+   * @param clock       time source, or NULL for HCArduinoClock (default)
+   */
+  void setClock(HCClock *clock);
+
+  /**
+   * @brief Remove and restore power of simulated module. Applies parity
+   *        setting of firmware 1.x, discards partial command and reply.
+   */
+  void powerCycle();
+
+  /** @returns baud rate of module UART */
+  unsigned long baud();
+  /** @returns parity of module UART (active setting) */
+  int parity();
+  /** @returns BT role of module (ROLE_xxx) */
+  int role();
+  /** @returns BT name of module */
+  const char *name();
+  /** @returns BT pin/passkey of module */
+  const char *pin();
+  /** @returns count of commands executed by module */
+  unsigned long commands();
+  /** @returns count of settings written to module flash */
+  unsigned long flashWrites();
+  /** @returns count of characters written to module by Serial1 */
+  unsigned long bytesWritten();
+  /** @returns count of begin() calls of Serial1 */
+  unsigned long uartBegins();
+  /** @returns count of end() calls of Serial1 */
+  unsigned long uartEnds();
+  /** @brief Clear counters of commands, flash writes, characters, begin() and end() */
+  void resetCounters();
+
+  /**
+   * @brief Open Serial1 side of simulated connection, discarding pending input.
+   *
+   * @param baud        baud rate of Serial1
+   * @param config      SERIAL_8N1, SERIAL_8O1 or SERIAL_8E1
+   */
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1);
+
+  /**
+   * @brief Close Serial1 side of simulated connection.
+   */
+  void end();
+
+  // Stream interface
+  int available();
+  int read();
+  int peek();
+  void flush();
+  size_t write(uint8_t c);
+  using Print::write;
+  operator bool() { return true; }
+
+private:
+  /**
+   * update
+   *
+   * @brief Execute firmware 1.x command once UART has been idle.
+   */
+  void update();
+
+  /**
+   * receive
+   *
+   * @brief Process character written to module (Serial1 TX).
+   */
+  void receive(char inChar);
+
+  /**
+   * execute
+   *
+   * @brief Execute complete command held in command buffer.
+   */
+  void execute();
+  void executeV1();
+  void executeV2();
+
+  /**
+   * reply
+   *
+   * @brief Queue reply from module, paced at module character rate, and
+   *        as received with current Serial1 settings.
+   *
+   * @param text        reply as sent by module
+   */
+  void reply(const char *text);
+
+  /**
+   * queueChar
+   *
+   * @brief Queue character of reply, arriving at time due (ms).
+   */
+  void queueChar(char inChar, unsigned long due);
+
+  /**
+   * misframe
+   *
+   * @brief Convert characters sent at module baud rate into characters
+   *        sampled at Serial1 baud rate (start bit found from each falling
+   *        edge, bits sampled at middle of Serial1 bit period).
+   *
+   * @returns count of characters written to output
+   */
+  int misframe(const char *text, char *output, int maxChars);
+
+  /** @returns count of bits of UART frame (8 data bits, parity, 1 stop) */
+  int frameBits(int parity);
+  /** @returns parity index of Serial1 configuration */
+  int hostParity();
+
+  // simulated module
+  HCClock *_clock;
+  int _model;
+  int _firmware;
+  unsigned long _baud;
+  int _parity;
+  int _pendingParity;           // fw 1.x parity setting, active after power-cycle
+  int _role;
+  char _name[HC_NAME_MAX + 1];
+  char _pin[HC_PIN_MAX + 1];
+  char _command[HC_SIM_BUFFER];
+  int _cmdLength;
+  bool _cmdGarbled;             // command received with mismatched settings
+  unsigned long _lastRx;        // time of last character received by module
+  int _baudMode;
+  int _parityMode;
+  // Serial1 side of connection
+  bool _open;
+  unsigned long _hostBaud;
+  uint32_t _hostConfig;
+  char _rxChars[HC_SIM_BUFFER];
+  unsigned long _rxDue[HC_SIM_BUFFER];
+  int _rxHead;
+  int _rxCount;
+  unsigned long _txFree;        // time at which module UART TX is idle
+  // counters
+  unsigned long _commands;
+  unsigned long _flashWrites;
+  unsigned long _bytesWritten;
+  unsigned long _begins;
+  unsigned long _ends;
+};
+
+/** simulated module connected to HCBT in place of Serial1 */
+extern HCSimulator HCSim;
+
+#endif // SIMULATEBT_H
@@ -0,0 +1,213 @@
+/**
+ * @file termiosBT.cpp
+ *
+ * HC-05/06 AT Command Center
+ *
+ *  Description: Serial port of a Linux host as UART of HCBT, see termiosBT.h.
+ */
+
+#ifdef HC_TERMIOS
+
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include "termiosBT.h"
+
+// termios speed for baud rate, or B0 if not supported
+static speed_t speedCode(unsigned long baud) {
+  switch (baud) {
+    case 1200:    return B1200;
+    case 2400:    return B2400;
+    case 4800:    return B4800;
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 921600:  return B921600;
+    default:      return B0;
+  }
+}
+
+HCTermios::HCTermios(const char *path) {
+  strncpy(_path, path, HC_PATH_MAX);
+  _path[HC_PATH_MAX] = '\0';
+  _fd = -1;
+  _began = false;
+  _peek = -1;
+  _baud = 0;
+  _error = 0;
+  _latency = HC_TERMIOS_LATENCY;
+}
+
+HCTermios::~HCTermios() {
+  close();
+}
+
+void HCTermios::begin(unsigned long baud, uint32_t config) {
+  int flags;
+
+  _began = false;
+  _peek = -1;
+  if (_fd < 0) {
+    // non-blocking open does not wait for carrier detect
+    _fd = ::open(_path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (_fd < 0) {
+      _error = errno;
+      return;
+    }
+    // writes block until queued, reads return at once (VMIN = VTIME = 0)
+    flags = fcntl(_fd, F_GETFL);
+    fcntl(_fd, F_SETFL, flags & ~O_NONBLOCK);
+    requestLowLatency();
+  }
+  if (!configure(baud, config))   return;
+  tcflush(_fd, TCIFLUSH);
+  _baud = baud;
+  _error = 0;
+  _began = true;
+}
+
+bool HCTermios::configure(unsigned long baud, uint32_t config) {
+  struct termios tty;
+  struct termios applied;
+  speed_t speed = speedCode(baud);
+
+  if (speed == B0) {
+    _error = EINVAL;
+    return false;
+  }
+  if (tcgetattr(_fd, &tty) != 0) {
+    _error = errno;
+    return false;
+  }
+  cfmakeraw(&tty);
+  tty.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD | CRTSCTS);
+  tty.c_cflag |= CS8 | CREAD | CLOCAL;
+  tty.c_iflag &= ~(IXON | IXOFF | IXANY | PARMRK);
+  if ((config == SERIAL_8O1) || (config == SERIAL_8E1)) {
+    tty.c_cflag |= PARENB;
+    if (config == SERIAL_8O1)   tty.c_cflag |= PARODD;
+    // characters failing parity check are dropped, as by Arduino core
+    tty.c_iflag |= INPCK | IGNPAR;
+  }
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  // settings apply once pending output has been transmitted at previous rate
+  if (tcsetattr(_fd, TCSADRAIN, &tty) != 0) {
+    _error = errno;
+    return false;
+  }
+  // tcsetattr() succeeds if any setting was applied, and some drivers (e.g.
+  //  pseudo-terminals) ignore parity, so settings are read back
+  if ((tcgetattr(_fd, &applied) != 0) || (cfgetospeed(&applied) != speed) ||
+        ((applied.c_cflag & (CSIZE | PARENB)) != (tty.c_cflag & (CSIZE | PARENB)))) {
+    _error = EINVAL;
+    return false;
+  }
+  return true;
+}
+
+void HCTermios::requestLowLatency() {
+  struct serial_struct serial;
+
+  // drivers without serial_struct (e.g. pseudo-terminals, CDC-ACM) reject 
+  //  request, and latency allowance still covers their delivery delay
+  if (ioctl(_fd, TIOCGSERIAL, &serial) != 0)   return;
+  serial.flags |= ASYNC_LOW_LATENCY;
+  ioctl(_fd, TIOCSSERIAL, &serial);
+}
+
+void HCTermios::end() {
+  if (_began)   tcdrain(_fd);
+  _began = false;
+  _peek = -1;
+}
+
+void HCTermios::close() {
+  end();
+  if (_fd >= 0)   ::close(_fd);
+  _fd = -1;
+}
+
+const char *HCTermios::path() {
+  return _path;
+}
+
+int HCTermios::fd() {
+  return _fd;
+}
+
+unsigned long HCTermios::baud() {
+  return _baud;
+}
+
+int HCTermios::error() {
+  return _error;
+}
+
+void HCTermios::setLatency(unsigned long ms) {
+  _latency = ms;
+}
+
+unsigned long HCTermios::latency() {
+  return _latency;
+}
+
+int HCTermios::available() {
+  int count = 0;
+
+  if (!_began)  return 0;
+  if (ioctl(_fd, FIONREAD, &count) != 0)  return 0;
+  return count + ((_peek >= 0) ? 1 : 0);
+}
+
+int HCTermios::read() {
+  int c = peek();
+
+  _peek = -1;
+  return c;
+}
+
+int HCTermios::peek() {
+  unsigned char inChar;
+
+  if (!_began)  return -1;
+  if ((_peek < 0) && (::read(_fd, &inChar, 1) == 1))  _peek = inChar;
+  return _peek;
+}
+
+void HCTermios::flush() {
+  if (_began)   tcdrain(_fd);
+}
+
+size_t HCTermios::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HCTermios::write(const uint8_t *buffer, size_t size) {
+  size_t sent = 0;
+  ssize_t count;
+
+  if (!_began)  return 0;
+  // command is written in one call, so module receives it without gaps
+  while (sent < size) {
+    count = ::write(_fd, buffer + sent, size - sent);
+    if (count < 0) {
+      if (errno == EINTR)   continue;
+      _error = errno;
+      break;
+    }
+    sent += count;
+  }
+  return sent;
+}
+
+#endif // HC_TERMIOS
@@ -0,0 +1,132 @@
+/**
+ * @file termiosBT.h
+ *
+ * HC-05/06 AT Command Center
+ *
+ *  Description: Serial port of a Linux host (e.g. USB-UART adapter at
+ *              /dev/ttyUSB0) as UART of HCBT, so modules may be detected and
+ *              configured from a PC without an Arduino serving as a bridge.
+ *              HCTermios implements the Stream and begin()/end() interface of
+ *              Serial1 over termios, for every rate of baudRateList and 8N1,
+ *              8O1 or 8E1 frames. Characters failing the parity check are
+ *              discarded, as by the Arduino core.
+ *
+ *              Build with HC_TERMIOS defined (e.g. with EpoxyDuino,
+ *              EXTRA_CXXFLAGS = -DHC_TERMIOS), which connects HCBT to an
+ *              HCTermios port given to its constructor:
+ *
+ *                HCTermios port("/dev/ttyUSB0");
+ *                HCBT hc0x(port);
+ *
+ *              KEY/STATE pins are not available, so HC-05 modules must be
+ *              held in AT mode by their adapter.
+ */
+
+#ifndef TERMIOSBT_H
+#define TERMIOSBT_H
+
+#ifndef HC_TERMIOS
+  #error "termiosBT.h requires host build with HC_TERMIOS defined"
+#endif
+
+#include <Arduino.h>
+#include "configureBT.h"
+
+/** maximum length of serial device path */
+#define HC_PATH_MAX           63
+/** default allowance (ms) for delivery latency of serial driver, e.g. 16 ms
+ *  latency timer of FTDI USB-UART adapters (see HCTermios::setLatency()) */
+#define HC_TERMIOS_LATENCY    20
+
+class HCTermios : public Stream
+{
+public:
+  /**
+   * @brief Constructor for port, opened by first begin().
+   *
+   * @param path        serial device, e.g. "/dev/ttyUSB0" or pseudo-terminal
+   */
+  HCTermios(const char *path);
+  ~HCTermios();
+
+  /**
+   * @brief Open port if not open, and set baud rate and frame format.
+   *        Discards pending input. On failure, port reads no characters and
+   *        error() returns cause (EINVAL if device does not support setting,
+   *        e.g. parity of pseudo-terminal).
+   *
+   * @param baud        baud rate, e.g. 9600 (any rate of baudRateList)
+   * @param config      SERIAL_8N1, SERIAL_8O1 or SERIAL_8E1
+   */
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1);
+
+  /**
+   * @brief Wait for pending output to be transmitted, and stop reading. The
+   *        device remains open, so its modem lines are not toggled.
+   */
+  void end();
+
+  /**
+   * @brief Close device (also closed by destructor).
+   */
+  void close();
+
+  /** @returns serial device path */
+  const char *path();
+  /** @returns file descriptor of open device, or -1 (e.g. for poll()) */
+  int fd();
+  /** @returns baud rate set by last successful begin() */
+  unsigned long baud();
+  /** @returns errno of last failed open or configuration, or 0 */
+  int error();
+
+  /**
+   * @brief Set allowance for delivery latency of serial driver, added by HCBT
+   *        to response timeouts and to idle period which ends fw 1.x replies.
+   *        begin() also requests low latency from drivers which support it.
+   *
+   * @param ms          latency allowance (default HC_TERMIOS_LATENCY), e.g. 0
+   *                    for on-board UART or adapter with 1 ms latency timer
+   */
+  void setLatency(unsigned long ms);
+  /** @returns latency allowance (ms) */
+  unsigned long latency();
+
+  // Stream interface
+  int available();
+  int read();
+  int peek();
+  void flush();
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+  operator bool() { return _began; }
+
+private:
+  /**
+   * configure
+   *
+   * @brief Apply baud rate and frame format to open device.
+   *
+   * @returns true if successful
+   */
+  bool configure(unsigned long baud, uint32_t config);
+
+  /**
+   * requestLowLatency
+   *
+   * @brief Ask driver to deliver received characters without delay (e.g.
+   *        1 ms latency timer of FTDI adapters). Ignored if not supported.
+   */
+  void requestLowLatency();
+
+  char _path[HC_PATH_MAX + 1];
+  int _fd;
+  bool _began;
+  int _peek;                    // character read by peek(), or -1
+  unsigned long _baud;
+  int _error;
+  unsigned long _latency;
+};
+
+#endif // TERMIOSBT_H